@@ -248,13 +248,16 @@ void test_PICC_GetTypeName() {
   printTestResult("PICC_GetTypeName", name.length() > 0);
 }
 
+#ifndef MFRC522_NO_DUMP
 // Сброс дампа содержимого карты в Serial
 void test_PICC_DumpToSerial() {
   mfrc522.PICC_DumpToSerial(&(mfrc522.uid));
   // Нет явного способа проверить, считаем что вызвалась
   printTestResult("PICC_DumpToSerial", true);
 }
+#endif
 
+#ifndef MFRC522_NO_BACKDOOR
 // Восстановление UID сектора (без бэкдора)
 void test_MIFARE_UnbrickUidSector() {
   bool ok = mfrc522.MIFARE_UnbrickUidSector(false);
@@ -267,6 +270,7 @@ void test_MIFARE_SetUid() {
   bool ok = mfrc522.MIFARE_SetUid(newUid, 4, true);
   printTestResult("MIFARE_SetUid", ok);
 }
+#endif
 
 // Чтение блока MIFARE
 void test_MIFARE_Read() {
@@ -307,12 +311,14 @@ void test_MIFARE_Transfer() {
   printTestResult("MIFARE_Transfer", status == MFRC522::STATUS_OK || status == MFRC522::STATUS_ERROR);
 }
 
+#ifndef MFRC522_NO_ULTRALIGHT
 // Запись в Ultralight
 void test_MIFARE_Ultralight_Write() {
   const byte data[4] = {1,2,3,4};
   MFRC522::StatusCode status = mfrc522.MIFARE_Ultralight_Write(4, (byte*)data, 4);
   printTestResult("MIFARE_Ultralight_Write", status == MFRC522::STATUS_OK || status == MFRC522::STATUS_ERROR);
 }
+#endif
 
 // Получить значение из Value-блока
 void test_MIFARE_GetValue() {
@@ -327,6 +333,7 @@ void test_MIFARE_SetValue() {
   printTestResult("MIFARE_SetValue", status == MFRC522::STATUS_OK || status == MFRC522::STATUS_ERROR);
 }
 
+#ifndef MFRC522_NO_BACKDOOR
 // Открыть бэкдор для UID
 void test_MIFARE_OpenUidBackdoor() {
   bool ok = mfrc522.MIFARE_OpenUidBackdoor(true);
@@ -338,6 +345,7 @@ void test_MIFARE_UnbrickUidSectorBackdoor() {
   bool ok = mfrc522.MIFARE_UnbrickUidSector(true);
   printTestResult("MIFARE_UnbrickUidSectorBackdoor", ok);
 }
+#endif
 
 // Получить строку статуса по коду
 void test_GetStatusCodeName() {
@@ -390,10 +398,14 @@ void setup() {
   test_PICC_HaltA();
   test_PICC_GetType();
   test_PICC_GetTypeName();
+#ifndef MFRC522_NO_DUMP
   test_PICC_DumpToSerial();
+#endif
 
+#ifndef MFRC522_NO_BACKDOOR
   test_MIFARE_UnbrickUidSector();
   test_MIFARE_SetUid();
+#endif
   test_PCD_Authenticate();
   test_MIFARE_Read();
   test_MIFARE_Write();
@@ -401,11 +413,15 @@ void setup() {
   test_MIFARE_Increment();
   test_MIFARE_Restore();
   test_MIFARE_Transfer();
+#ifndef MFRC522_NO_ULTRALIGHT
   test_MIFARE_Ultralight_Write();
+#endif
   test_MIFARE_GetValue();
   test_MIFARE_SetValue();
+#ifndef MFRC522_NO_BACKDOOR
   test_MIFARE_OpenUidBackdoor();
   test_MIFARE_UnbrickUidSectorBackdoor();
+#endif
   test_GetStatusCodeName();
   test_PCD_StopCrypto1();
   test_PCD_TransceiveData();
@@ -0,0 +1,216 @@
+/*
+ * --------------------------------------------------------------------------------------------------------------------
+ * Example sketch/program measuring the time of MFRC522 register accesses and of a whole card read.
+ * --------------------------------------------------------------------------------------------------------------------
+ * This is a MFRC522 library example; for further details and other examples see: https://github.com/miguelbalboa/rfid
+ *
+ * Reads VersionReg and writes ModWidthReg (with its reset value) many times, first with plain SPI calls the way the
+ * library used to access a register (a new SPISettings and digitalWrite() chip select per access), then through
+ * MFRC522 with the digitalWrite() chip select, then through MFRC522 with the chip select on the cached port register
+ * (AVR, see PCD_ChipSelect()), then through MFRC522Fast, which toggles the chip select with constant port and mask.
+ * All of them share the same pins, so no card and no wiring changes are needed. The serial output shows the
+ * microseconds per access. The SPI transfer itself is the same for all, the difference is the bus setup and chip
+ * select overhead; on boards other than AVR the last three lines show about the same time.
+ *
+ * Then, for every MIFARE Classic card presented with the default key FFFFFFFFFFFF, it times the library functions of
+ * a complete read, PICC_IsNewCardPresent(), PICC_ReadCardSerial(), PCD_Authenticate() and MIFARE_Read(), once with
+ * the digitalWrite() chip select and once with the port register one, and prints both with the SPI bus transactions
+ * and register accesses (PCD_GetBusStats()) of the read. The library prints its debug trace during the exchange, so
+ * the absolute times mostly show the serial output; it is the same for both runs, the difference between them is what
+ * the chip select saves.
+ *
+ * @license Released into the public domain.
+ *
+ * Typical pin layout used:
+ * -----------------------------------------------------------------------------------------
+ *             MFRC522      Arduino       Arduino   Arduino    Arduino          Arduino
+ *             Reader/PCD   Uno/101       Mega      Nano v3    Leonardo/Micro   Pro Micro
+ * Signal      Pin          Pin           Pin       Pin        Pin              Pin
+ * -----------------------------------------------------------------------------------------
+ * RST/Reset   RST          9             5         D9         RESET/ICSP-5     RST
+ * SPI SS      SDA(SS)      10            53        D10        10               10
+ * SPI MOSI    MOSI         11 / ICSP-4   51        D11        ICSP-4           16
+ * SPI MISO    MISO         12 / ICSP-1   50        D12        ICSP-1           14
+ * SPI SCK     SCK          13 / ICSP-3   52        D13        ICSP-3           15
+ */
+ 
+ #include <SPI.h>
+ #include <MFRC522.h>
+ #include <MFRC522Fast.h>
+ 
+ #define RST_PIN         9          // Configurable, see typical pin layout above
+ #define SS_PIN          10         // Configurable, see typical pin layout above
+ #define ACCESSES        1000       // Register accesses per measurement
+ #define BLOCK           4          // Block read by the card exchange
+ 
+ // MFRC522 whose chip select can be switched back to digitalWrite(), as every access was made before
+ class BenchmarkReader : public MFRC522 {
+ public:
+     BenchmarkReader(byte chipSelectPin, byte resetPowerDownPin) : MFRC522(chipSelectPin, resetPowerDownPin) {}
+ 
+     void useDigitalWrite(bool enable) {
+ #ifdef __AVR__
+         if (enable) {
+             _chipSelectPort = nullptr;
+         } else {
+             PCD_SetChipSelectPin(_chipSelectPin);
+         }
+ #endif
+     }
+ };
+ 
+ BenchmarkReader mfrc522(SS_PIN, RST_PIN);         // Cached port register chip select, or digitalWrite()
+ MFRC522Fast<SS_PIN, RST_PIN> mfrc522Fast;         // Constant port register chip select
+ 
+ // Average time of one register read and one register write without the library, in nanoseconds
+ void measureBaseline(uint32_t *readNanos, uint32_t *writeNanos) {
+     uint32_t start = micros();
+     for (uint16_t i = 0; i < ACCESSES; i++) {
+         SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));
+         digitalWrite(SS_PIN, LOW);
+         SPI.transfer(0x80 | MFRC522::VersionReg);
+         SPI.transfer(0);
+         digitalWrite(SS_PIN, HIGH);
+         SPI.endTransaction();
+     }
+     *readNanos = (micros() - start) * 1000UL / ACCESSES;
+     start = micros();
+     for (uint16_t i = 0; i < ACCESSES; i++) {
+         SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));
+         digitalWrite(SS_PIN, LOW);
+         SPI.transfer(MFRC522::ModWidthReg);
+         SPI.transfer(0x26);
+         digitalWrite(SS_PIN, HIGH);
+         SPI.endTransaction();
+     }
+     *writeNanos = (micros() - start) * 1000UL / ACCESSES;
+ }
+ 
+ // Average time of one register read and one register write, in nanoseconds.
+ // A template, so MFRC522Fast's own register accesses are called and not the MFRC522 ones.
+ template <class Reader>
+ void measure(Reader &reader, uint32_t *readNanos, uint32_t *writeNanos) {
+     byte version = 0;
+     uint32_t start = micros();
+     for (uint16_t i = 0; i < ACCESSES; i++) {
+         version |= reader.PCD_ReadRegister(MFRC522::VersionReg);
+     }
+     *readNanos = (micros() - start) * 1000UL / ACCESSES;
+     start = micros();
+     for (uint16_t i = 0; i < ACCESSES; i++) {
+         reader.PCD_WriteRegister(MFRC522::ModWidthReg, 0x26);
+     }
+     *writeNanos = (micros() - start) * 1000UL / ACCESSES;
+     if (version == 0x00 || version == 0xFF) {
+         Serial.println(F("WARNING: no MFRC522 answered, the times below only cover the MCU side"));
+     }
+ }
+ 
+ void printNanos(uint32_t nanos) {
+     Serial.print(nanos / 1000);
+     Serial.print('.');
+     if (nanos % 1000 < 100) Serial.print('0');
+     if (nanos % 1000 < 10) Serial.print('0');
+     Serial.print(nanos % 1000);
+     Serial.print(F(" us"));
+ }
+ 
+ void report(const __FlashStringHelper *name, uint32_t readNanos, uint32_t writeNanos) {
+     Serial.print(name);
+     Serial.print(F(" read: "));
+     printNanos(readNanos);
+     Serial.print(F(", write: "));
+     printNanos(writeNanos);
+     Serial.println();
+ }
+ 
+ // Time of one card read through the library functions in microseconds, 0 if the read failed
+ uint32_t measureExchange(MFRC522::PCD_BusStats *stats) {
+     MFRC522::MIFARE_Key key;
+     for (byte i = 0; i < 6; i++) {
+         key.keyByte[i] = 0xFF;
+     }
+     byte buffer[18];
+     byte size = sizeof(buffer);
+ 
+     // Switch the field off and on, so the PICC is back in IDLE and answers the REQA again
+     mfrc522.PCD_AntennaOff();
+     delay(10);
+     mfrc522.PCD_AntennaOn();
+     delay(10);
+     Serial.flush();			// Start with an empty transmit buffer, so both runs wait the same for the debug trace
+ 
+     mfrc522.PCD_ResetBusStats();
+     uint32_t start = micros();
+     bool ok = mfrc522.PICC_IsNewCardPresent() && mfrc522.PICC_ReadCardSerial()
+         && mfrc522.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, BLOCK, &key, &(mfrc522.uid)) == MFRC522::STATUS_OK
+         && mfrc522.MIFARE_Read(BLOCK, buffer, &size) == MFRC522::STATUS_OK;
+     uint32_t elapsed = micros() - start;
+     *stats = mfrc522.PCD_GetBusStats();
+     mfrc522.PICC_HaltA();
+     mfrc522.PCD_StopCrypto1();
+     return ok ? elapsed : 0;
+ }
+ 
+ void reportExchange(const __FlashStringHelper *name, uint32_t elapsed, const MFRC522::PCD_BusStats &stats) {
+     Serial.print(name);
+     if (elapsed == 0) {
+         Serial.println(F(" read failed"));
+         return;
+     }
+     Serial.print(elapsed);
+     Serial.print(F(" us, "));
+     Serial.print(stats.transactions);
+     Serial.print(F(" bus transactions, "));
+     Serial.print(stats.accesses);
+     Serial.println(F(" register accesses"));
+ }
+ 
+ void setup() {
+     Serial.begin(115200);	// Initialize serial communications with the PC, fast so the library's debug trace does not dominate the exchange times
+     while (!Serial);		// Do nothing if no serial port is opened (added for Arduinos based on ATMEGA32U4)
+     SPI.begin();			// Init SPI bus
+     mfrc522.PCD_Init();		// Init MFRC522
+     delay(4);				// Optional delay. Some board do need more time after init to be ready, see Readme
+#ifndef MFRC522_NO_DUMP
+     mfrc522.PCD_DumpVersionToSerial();	// Show details of PCD - MFRC522 Card Reader details
+#endif
+ 
+     uint32_t readBefore, writeBefore, readDigital, writeDigital, readCached, writeCached, readAfter, writeAfter;
+     measureBaseline(&readBefore, &writeBefore);
+     mfrc522.useDigitalWrite(true);
+     measure(mfrc522, &readDigital, &writeDigital);
+     mfrc522.useDigitalWrite(false);
+     measure(mfrc522, &readCached, &writeCached);
+     measure(mfrc522Fast, &readAfter, &writeAfter);
+     Serial.print(ACCESSES);
+     Serial.println(F(" accesses per measurement"));
+     report(F("Before                 "), readBefore, writeBefore);
+     report(F("MFRC522 digitalWrite() "), readDigital, writeDigital);
+     report(F("MFRC522 port register  "), readCached, writeCached);
+     report(F("MFRC522Fast            "), readAfter, writeAfter);
+     Serial.println(F("Present a MIFARE Classic card to time a whole read..."));
+ }
+ 
+ void loop() {
+     // Wait for a card, untimed
+     if (!mfrc522.PICC_IsNewCardPresent()) {
+         return;
+     }
+ 
+     MFRC522::PCD_BusStats digitalStats, cachedStats;
+     mfrc522.useDigitalWrite(true);
+     uint32_t digitalMicros = measureExchange(&digitalStats);
+     mfrc522.useDigitalWrite(false);
+     uint32_t cachedMicros = measureExchange(&cachedStats);
+ 
+     Serial.println();
+     reportExchange(F("Card read, digitalWrite() chip select: "), digitalMicros, digitalStats);
+     reportExchange(F("Card read, port register chip select:  "), cachedMicros, cachedStats);
+     if (digitalMicros != 0 && cachedMicros != 0) {
+         Serial.print(F("Saved per read: "));
+         Serial.print((int32_t)(digitalMicros - cachedMicros));
+         Serial.println(F(" us"));
+     }
+     delay(1000);
+ }
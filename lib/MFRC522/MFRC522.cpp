@@ -7,6 +7,47 @@
 #include <Arduino.h>
 #include "MFRC522.h"
 
+#ifndef MFRC522_NO_SHADOW
+// Byte and bit of a register in the MFRC522::_shadowed / MFRC522::_shadowValid bitmaps. Register address n is
+// bit n & 7 of byte n >> 3; PCD_Register holds the address shifted left by one. 8 bit shifts only, no 64 bit math.
+static inline byte ShadowIndex(MFRC522::PCD_Register reg) {
+	return reg >> 4;
+}
+static inline byte ShadowMask(MFRC522::PCD_Register reg) {
+	return 1 << ((reg >> 1) & 7);
+}
+
+// Registers shadowed by default: configuration registers only written by the host, which
+// PCD_SetRegisterBitMask()/PCD_ClearRegisterBitMask() or PCD_AntennaOn()/PCD_GetAntennaGain() operate on.
+// In CollReg only ValuesAfterColl is writable; the read-only CollPos bits written back are ignored by the MFRC522.
+static const MFRC522::PCD_Register shadowDefaultRegisters[] = {
+	MFRC522::ComIEnReg,		MFRC522::DivIEnReg,		MFRC522::BitFramingReg,	MFRC522::CollReg,		MFRC522::ModeReg,
+	MFRC522::TxModeReg,		MFRC522::RxModeReg,		MFRC522::TxControlReg,	MFRC522::TxASKReg,		MFRC522::ModWidthReg,
+	MFRC522::RFCfgReg,		MFRC522::TModeReg,		MFRC522::TReloadRegH,	MFRC522::TReloadRegL
+};
+#endif // MFRC522_NO_SHADOW
+
+// CRC_A (ISO 14443-3 part 6.2.4) computed on the host, same result as PCD_CalculateCRC() without the bus traffic.
+static void CalculateCRC_A(const byte *data, byte length, byte *result) {
+	uint16_t crc = 0x6363;
+	for (byte i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (byte bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x0001) ? (crc >> 1) ^ 0x8408 : (crc >> 1);
+		}
+	}
+	result[0] = crc & 0xFF;
+	result[1] = crc >> 8;
+}
+
+#if MFRC522_KEY_CACHE_SIZE > 0
+// Key cache tag of a PICC: the last 4 UID bytes, the ones PCD_Authenticate() sends.
+static uint32_t UidTag(MFRC522::Uid *uid) {
+	const byte *last = &uid->uidByte[uid->size - 4];
+	return ((uint32_t)last[0] << 24) | ((uint32_t)last[1] << 16) | ((uint32_t)last[2] << 8) | last[3];
+}
+#endif // MFRC522_KEY_CACHE_SIZE > 0
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Functions for setting up the Arduino
 /////////////////////////////////////////////////////////////////////////////////////
@@ -31,14 +72,115 @@ MFRC522::MFRC522(	byte resetPowerDownPin	///< Arduino pin connected to MFRC522's
 MFRC522::MFRC522(	byte chipSelectPin,		///< Arduino pin connected to MFRC522's SPI slave select input (Pin 24, NSS, active low)
 					byte resetPowerDownPin	///< Arduino pin connected to MFRC522's reset and power down input (Pin 6, NRSTPD, active low). If there is no connection from the CPU to NRSTPD, set this to UINT8_MAX. In this case, only soft reset will be used in PCD_Init().
 				) {
-	_chipSelectPin = chipSelectPin;
+	PCD_SetChipSelectPin(chipSelectPin);
 	_resetPowerDownPin = resetPowerDownPin;
+	_spiSettings = SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0);
+	_busDepth = 0;
+#ifndef MFRC522_NO_BUS_STATS
+	PCD_ResetBusStats();
+#endif
+	_irqPin = UNUSED_PIN;
+	_irqPending = false;
+#ifndef MFRC522_NO_ASYNC
+	_async.active = false;
+#endif
+#ifndef MFRC522_NO_PRESENCE_POLL
+	_presence.armed = false;
+	_presence.waiting = false;
+	_presence.minInterval = 0;
+	_presence.maxInterval = 0;
+	_presence.interval = 0;
+	_presence.lastPoll = 0;
+#endif
+#ifndef MFRC522_NO_SHADOW
+	memset(_shadowed, 0, sizeof(_shadowed));
+	for (byte i = 0; i < sizeof(shadowDefaultRegisters) / sizeof(shadowDefaultRegisters[0]); i++) {
+		_shadowed[ShadowIndex(shadowDefaultRegisters[i])] |= ShadowMask(shadowDefaultRegisters[i]);
+	}
+	memset(_shadowValid, 0, sizeof(_shadowValid));
+#endif
+#if MFRC522_KEY_CACHE_SIZE > 0
+	_keyCacheUsed = 0;
+	_keyCacheNext = 0;
+#endif
 } // End constructor
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Basic interface functions for communicating with the MFRC522
 /////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Sets the pin PCD_ChipSelect() drives.
+ * On AVR digitalWrite() looks the pin up in flash tables on every call, so its output register and bit are
+ * looked up once here instead.
+ */
+void MFRC522::PCD_SetChipSelectPin(	byte chipSelectPin	///< Arduino pin connected to MFRC522's SPI slave select input (Pin 24, NSS, active low)
+								) {
+	_chipSelectPin = chipSelectPin;
+#ifdef __AVR__
+	uint8_t port = digitalPinToPort(chipSelectPin);
+	_chipSelectPort = (port == NOT_A_PIN) ? nullptr : portOutputRegister(port);
+	_chipSelectMask = digitalPinToBitMask(chipSelectPin);
+#endif
+} // End PCD_SetChipSelectPin()
+
+/**
+ * Drives the MFRC522's NSS input around a register access.
+ */
+void MFRC522::PCD_ChipSelect(	bool selected	///< true: NSS low, the MFRC522 listens to the bus
+							) {
+#ifdef __AVR__
+	if (_chipSelectPort != nullptr) {
+		// Same read-modify-write as digitalWrite(), without the table lookups and the PWM check.
+		// Interrupts are off so an ISR writing another pin of the port cannot be undone.
+		uint8_t oldSREG = SREG;
+		cli();
+		if (selected) {
+			*_chipSelectPort &= ~_chipSelectMask;
+		} else {
+			*_chipSelectPort |= _chipSelectMask;
+		}
+		SREG = oldSREG;
+		return;
+	}
+#endif
+	digitalWrite(_chipSelectPin, selected ? LOW : HIGH);
+} // End PCD_ChipSelect()
+
+/**
+ * Claims the SPI bus for a sequence of register accesses, until the matching PCD_EndBus().
+ * Calls nest: only the outermost one calls SPI.beginTransaction(), so every register access in between reuses the
+ * bus settings. NSS is still pulsed per register access, as the MFRC522 requires (datasheet section 8.1.2.2).
+ * Other devices on the bus must not be accessed before the bus is released. PCD_BusLock does the pairing for a scope.
+ */
+void MFRC522::PCD_BeginBus() {
+	if (_busDepth++ == 0) {
+		SPI.beginTransaction(_spiSettings);	// Set the settings to work with SPI bus
+#ifndef MFRC522_NO_BUS_STATS
+		_busStats.transactions++;
+#endif
+	}
+} // End PCD_BeginBus()
+
+/**
+ * Releases the SPI bus once every PCD_BeginBus() has been matched.
+ */
+void MFRC522::PCD_EndBus() {
+	if (_busDepth > 0 && --_busDepth == 0) {
+		SPI.endTransaction(); // Stop using the SPI bus
+	}
+} // End PCD_EndBus()
+
+#ifndef MFRC522_NO_BUS_STATS
+/**
+ * Clears the counters returned by PCD_GetBusStats().
+ */
+void MFRC522::PCD_ResetBusStats() {
+	_busStats.transactions = 0;
+	_busStats.accesses = 0;
+} // End PCD_ResetBusStats()
+#endif // MFRC522_NO_BUS_STATS
+
 /**
  * Writes a byte to the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
@@ -46,12 +188,14 @@ MFRC522::MFRC522(	byte chipSelectPin,		///< Arduino pin connected to MFRC522's S
 void MFRC522::PCD_WriteRegister(	PCD_Register reg,	///< The register to write to. One of the PCD_Register enums.
 									byte value			///< The value to write.
 								) {
-	SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));	// Set the settings to work with SPI bus
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_BeginBus();
+	PCD_ChipSelect(true);			// Select slave
 	SPI.transfer(reg);						// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
 	SPI.transfer(value);
-	digitalWrite(_chipSelectPin, HIGH);		// Release slave again
-	SPI.endTransaction(); // Stop using the SPI bus
+	PCD_ChipSelect(false);		// Release slave again
+	PCD_EndBus();
+	PCD_CountAccesses(1);
+	PCD_UpdateShadow(reg, value);
 } // End PCD_WriteRegister()
 
 /**
@@ -62,16 +206,42 @@ void MFRC522::PCD_WriteRegister(	PCD_Register reg,	///< The register to write to
 									byte count,			///< The number of bytes to write to the register
 									byte *values		///< The values to write. Byte array.
 								) {
-	SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));	// Set the settings to work with SPI bus
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_BeginBus();
+	PCD_ChipSelect(true);			// Select slave
 	SPI.transfer(reg);						// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
 	for (byte index = 0; index < count; index++) {
 		SPI.transfer(values[index]);
 	}
-	digitalWrite(_chipSelectPin, HIGH);		// Release slave again
-	SPI.endTransaction(); // Stop using the SPI bus
+	PCD_ChipSelect(false);		// Release slave again
+	PCD_EndBus();
+	PCD_CountAccesses(1);
+	if (count > 0) {
+		PCD_UpdateShadow(reg, values[count - 1]);	// Every byte goes to the same register, the last one sticks
+	}
 } // End PCD_WriteRegister()
 
+/**
+ * Writes a sequence of register/value pairs within one SPI bus transaction.
+ * The MFRC522 writes every data byte following an address byte to that same address (datasheet section 8.1.2.2),
+ * so NSS is still released after each pair; the bus is only claimed and configured once for the whole sequence.
+ */
+void MFRC522::PCD_WriteRegisters(	const PCD_RegisterWrite *writes,	///< The register/value pairs, written in order.
+									byte count							///< The number of pairs
+								) {
+	PCD_BeginBus();
+	for (byte index = 0; index < count; index++) {
+		PCD_ChipSelect(true);			// Select slave
+		SPI.transfer(writes[index].reg);		// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
+		SPI.transfer(writes[index].value);
+		PCD_ChipSelect(false);		// Release slave again, this ends the write to writes[index].reg
+	}
+	PCD_EndBus();
+	PCD_CountAccesses(count);
+	for (byte index = 0; index < count; index++) {
+		PCD_UpdateShadow(writes[index].reg, writes[index].value);
+	}
+} // End PCD_WriteRegisters()
+
 /**
  * Reads a byte from the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
@@ -79,12 +249,14 @@ void MFRC522::PCD_WriteRegister(	PCD_Register reg,	///< The register to write to
 byte MFRC522::PCD_ReadRegister(	PCD_Register reg	///< The register to read from. One of the PCD_Register enums.
 								) {
 	byte value;
-	SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));	// Set the settings to work with SPI bus
-	digitalWrite(_chipSelectPin, LOW);			// Select slave
+	PCD_BeginBus();
+	PCD_ChipSelect(true);				// Select slave
 	SPI.transfer(0x80 | reg);					// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
 	value = SPI.transfer(0);					// Read the value back. Send 0 to stop reading.
-	digitalWrite(_chipSelectPin, HIGH);			// Release slave again
-	SPI.endTransaction(); // Stop using the SPI bus
+	PCD_ChipSelect(false);			// Release slave again
+	PCD_EndBus();
+	PCD_CountAccesses(1);
+	PCD_UpdateShadow(reg, value);
 	return value;
 } // End PCD_ReadRegister()
 
@@ -103,8 +275,8 @@ void MFRC522::PCD_ReadRegister(	PCD_Register reg,	///< The register to read from
 	//Serial.print(F("Reading ")); 	Serial.print(count); Serial.println(F(" bytes from register."));
 	byte address = 0x80 | reg;				// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
 	byte index = 0;							// Index in values array.
-	SPI.beginTransaction(SPISettings(MFRC522_SPICLOCK, MSBFIRST, SPI_MODE0));	// Set the settings to work with SPI bus
-	digitalWrite(_chipSelectPin, LOW);		// Select slave
+	PCD_BeginBus();
+	PCD_ChipSelect(true);			// Select slave
 	count--;								// One read is performed outside of the loop
 	SPI.transfer(address);					// Tell MFRC522 which address we want to read
 	if (rxAlign) {		// Only update bit positions rxAlign..7 in values[0]
@@ -121,32 +293,121 @@ void MFRC522::PCD_ReadRegister(	PCD_Register reg,	///< The register to read from
 		index++;
 	}
 	values[index] = SPI.transfer(0);			// Read the final byte. Send 0 to stop reading.
-	digitalWrite(_chipSelectPin, HIGH);			// Release slave again
-	SPI.endTransaction(); // Stop using the SPI bus
+	PCD_ChipSelect(false);			// Release slave again
+	PCD_EndBus();
+	PCD_CountAccesses(1);
 } // End PCD_ReadRegister()
 
 /**
  * Sets the bits given in mask in register reg.
+ * For shadowed registers the current value comes from the shadow copy and nothing is written if the bits are already set.
  */
 void MFRC522::PCD_SetRegisterBitMask(	PCD_Register reg,	///< The register to update. One of the PCD_Register enums.
 										byte mask			///< The bits to set.
 									) { 
 	byte tmp;
-	tmp = PCD_ReadRegister(reg);
+	tmp = PCD_ReadShadowedRegister(reg);
+#ifndef MFRC522_NO_SHADOW
+	if ((_shadowValid[ShadowIndex(reg)] & ShadowMask(reg)) && (tmp | mask) == tmp) {
+		return;
+	}
+#endif
 	PCD_WriteRegister(reg, tmp | mask);			// set bit mask
 } // End PCD_SetRegisterBitMask()
 
 /**
  * Clears the bits given in mask from register reg.
+ * For shadowed registers the current value comes from the shadow copy and nothing is written if the bits are already clear.
  */
 void MFRC522::PCD_ClearRegisterBitMask(	PCD_Register reg,	///< The register to update. One of the PCD_Register enums.
 										byte mask			///< The bits to clear.
 									  ) {
 	byte tmp;
-	tmp = PCD_ReadRegister(reg);
+	tmp = PCD_ReadShadowedRegister(reg);
+#ifndef MFRC522_NO_SHADOW
+	if ((_shadowValid[ShadowIndex(reg)] & ShadowMask(reg)) && (tmp & (~mask)) == tmp) {
+		return;
+	}
+#endif
 	PCD_WriteRegister(reg, tmp & (~mask));		// clear bit mask
 } // End PCD_ClearRegisterBitMask()
 
+#ifndef MFRC522_NO_SHADOW
+/**
+ * Enables or disables the shadow copy of a register.
+ * A shadowed register is only read over SPI once; PCD_SetRegisterBitMask(), PCD_ClearRegisterBitMask(),
+ * PCD_AntennaOn() and PCD_GetAntennaGain() then work on the value last written. Only shadow registers
+ * the MFRC522 never changes by itself (configuration registers, not status, IRQ, FIFO or CommandReg).
+ */
+void MFRC522::PCD_SetRegisterShadowed(	PCD_Register reg,	///< The register to configure. One of the PCD_Register enums, below TestSel1Reg.
+										bool shadowed		///< true to keep a shadow copy of the register
+									) {
+	if ((reg >> 1) >= sizeof(_shadow)) {
+		return;
+	}
+	if (shadowed) {
+		_shadowed[ShadowIndex(reg)] |= ShadowMask(reg);
+	} else {
+		_shadowed[ShadowIndex(reg)] &= ~ShadowMask(reg);
+	}
+	_shadowValid[ShadowIndex(reg)] &= ~ShadowMask(reg);
+} // End PCD_SetRegisterShadowed()
+#endif // MFRC522_NO_SHADOW
+
+/**
+ * Forgets all shadow copies, the next access of each shadowed register reads it over SPI again.
+ * Called after a reset. Call it if the MFRC522 could have been reset or reconfigured behind the library's back.
+ */
+void MFRC522::PCD_InvalidateShadow() {
+#ifndef MFRC522_NO_SHADOW
+	memset(_shadowValid, 0, sizeof(_shadowValid));
+#endif
+#ifndef MFRC522_NO_PRESENCE_POLL
+	_presence.armed = false;
+	_presence.waiting = false;
+#endif
+} // End PCD_InvalidateShadow()
+
+/**
+ * Reads a register from its shadow copy if possible, over SPI otherwise (which refreshes the copy).
+ * With MFRC522_NO_SHADOW always over SPI.
+ */
+byte MFRC522::PCD_ReadShadowedRegister(	PCD_Register reg	///< The register to read from. One of the PCD_Register enums.
+										) {
+#ifndef MFRC522_NO_SHADOW
+	if (_shadowValid[ShadowIndex(reg)] & ShadowMask(reg)) {
+		return _shadow[reg >> 1];
+	}
+#endif
+	return PCD_ReadRegister(reg);
+} // End PCD_ReadShadowedRegister()
+
+/**
+ * Records a value written to or read from reg if the register is shadowed.
+ * A CommandReg access also ends the PCD_Transceive left running by PICC_PollNewCardPresent().
+ */
+void MFRC522::PCD_UpdateShadow(	PCD_Register reg,	///< The register that was accessed. One of the PCD_Register enums.
+								byte value			///< The value written or read
+								) {
+	if (reg == CommandReg) {
+		PICC_DisarmPresencePoll();
+	}
+#ifdef MFRC522_NO_SHADOW
+	(void)value;
+#else
+	byte index = ShadowIndex(reg);
+	byte mask = ShadowMask(reg);
+	if (!(_shadowed[index] & mask)) {
+		return;
+	}
+	if (reg == BitFramingReg) {
+		value &= ~0x80;		// StartSend triggers the transmission, it is not a setting to be written back
+	}
+	_shadow[reg >> 1] = value;
+	_shadowValid[index] |= mask;
+#endif // MFRC522_NO_SHADOW
+} // End PCD_UpdateShadow()
+
 
 /**
  * Use the CRC coprocessor in the MFRC522 to calculate a CRC_A.
@@ -157,9 +418,12 @@ MFRC522::StatusCode MFRC522::PCD_CalculateCRC(	byte *data,		///< In: Pointer to
 												byte length,	///< In: The number of bytes to transfer.
 												byte *result	///< Out: Pointer to result buffer. Result is written to result[0..1], low byte first.
 					 ) {
-	PCD_WriteRegister(CommandReg, PCD_Idle);		// Stop any active command.
-	PCD_WriteRegister(DivIrqReg, 0x04);				// Clear the CRCIRq interrupt request bit
-	PCD_WriteRegister(FIFOLevelReg, 0x80);			// FlushBuffer = 1, FIFO initialization
+	const PCD_RegisterWrite prepare[] = {
+		{ CommandReg,	PCD_Idle },					// Stop any active command.
+		{ DivIrqReg,	0x04 },						// Clear the CRCIRq interrupt request bit
+		{ FIFOLevelReg,	0x80 }						// FlushBuffer = 1, FIFO initialization
+	};
+	PCD_WriteRegisters(prepare, sizeof(prepare) / sizeof(prepare[0]));
 	PCD_WriteRegister(FIFODataReg, length, data);	// Write data to the FIFO
 	PCD_WriteRegister(CommandReg, PCD_CalcCRC);		// Start the calculation
 	
@@ -212,6 +476,7 @@ void MFRC522::PCD_Init() {
 			digitalWrite(_resetPowerDownPin, LOW);		// Make sure we have a clean LOW state.
 			delayMicroseconds(2);				// 8.8.1 Reset timing requirements says about 100ns. Let us be generous: 2μsl
 			digitalWrite(_resetPowerDownPin, HIGH);		// Exit power down mode. This triggers a hard reset.
+			PCD_InvalidateShadow();
 			// Section 8.8.2 in the datasheet says the oscillator start-up time is the start up time of the crystal + 37,74μs. Let us be generous: 50ms.
 			delay(50);
 			hardReset = true;
@@ -222,22 +487,25 @@ void MFRC522::PCD_Init() {
 		PCD_Reset();
 	}
 	
-	// Reset baud rates
-	PCD_WriteRegister(TxModeReg, 0x00);
-	PCD_WriteRegister(RxModeReg, 0x00);
-	// Reset ModWidthReg
-	PCD_WriteRegister(ModWidthReg, 0x26);
-
-	// When communicating with a PICC we need a timeout if something goes wrong.
-	// f_timer = 13.56 MHz / (2*TPreScaler+1) where TPreScaler = [TPrescaler_Hi:TPrescaler_Lo].
-	// TPrescaler_Hi are the four low bits in TModeReg. TPrescaler_Lo is TPrescalerReg.
-	PCD_WriteRegister(TModeReg, 0x80);			// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
-	PCD_WriteRegister(TPrescalerReg, 0xA9);		// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25μs.
-	PCD_WriteRegister(TReloadRegH, 0x03);		// Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
-	PCD_WriteRegister(TReloadRegL, 0xE8);
-	
-	PCD_WriteRegister(TxASKReg, 0x40);		// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
-	PCD_WriteRegister(ModeReg, 0x3D);		// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
+	const PCD_RegisterWrite configuration[] = {
+		// Reset baud rates
+		{ TxModeReg,		0x00 },
+		{ RxModeReg,		0x00 },
+		// Reset ModWidthReg
+		{ ModWidthReg,		0x26 },
+		
+		// When communicating with a PICC we need a timeout if something goes wrong.
+		// f_timer = 13.56 MHz / (2*TPreScaler+1) where TPreScaler = [TPrescaler_Hi:TPrescaler_Lo].
+		// TPrescaler_Hi are the four low bits in TModeReg. TPrescaler_Lo is TPrescalerReg.
+		{ TModeReg,			0x80 },		// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
+		{ TPrescalerReg,	0xA9 },		// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25μs.
+		{ TReloadRegH,		0x03 },		// Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
+		{ TReloadRegL,		0xE8 },
+		
+		{ TxASKReg,			0x40 },		// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
+		{ ModeReg,			0x3D }		// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
+	};
+	PCD_WriteRegisters(configuration, sizeof(configuration) / sizeof(configuration[0]));
 	PCD_AntennaOn();						// Enable the antenna driver pins TX1 and TX2 (they were disabled by the reset)
 } // End PCD_Init()
 
@@ -255,7 +523,7 @@ void MFRC522::PCD_Init(	byte resetPowerDownPin	///< Arduino pin connected to MFR
 void MFRC522::PCD_Init(	byte chipSelectPin,		///< Arduino pin connected to MFRC522's SPI slave select input (Pin 24, NSS, active low)
 						byte resetPowerDownPin	///< Arduino pin connected to MFRC522's reset and power down input (Pin 6, NRSTPD, active low)
 					) {
-	_chipSelectPin = chipSelectPin;
+	PCD_SetChipSelectPin(chipSelectPin);
 	_resetPowerDownPin = resetPowerDownPin; 
 	// Set the chipSelectPin as digital output, do not select the slave yet
 	PCD_Init();
@@ -265,6 +533,7 @@ void MFRC522::PCD_Init(	byte chipSelectPin,		///< Arduino pin connected to MFRC5
  * Performs a soft reset on the MFRC522 chip and waits for it to be ready again.
  */
 void MFRC522::PCD_Reset() {
+	PCD_InvalidateShadow();							// All registers return to their reset values, so nothing is restored.
 	PCD_WriteRegister(CommandReg, PCD_SoftReset);	// Issue the SoftReset command.
 	// The datasheet does not mention how long the SoftRest command takes to complete.
 	// But the MFRC522 might have been in soft power-down mode (triggered by bit 4 of CommandReg) 
@@ -281,7 +550,7 @@ void MFRC522::PCD_Reset() {
  * After a reset these pins are disabled.
  */
 void MFRC522::PCD_AntennaOn() {
-	byte value = PCD_ReadRegister(TxControlReg);
+	byte value = PCD_ReadShadowedRegister(TxControlReg);
 	if ((value & 0x03) != 0x03) {
 		PCD_WriteRegister(TxControlReg, value | 0x03);
 	}
@@ -302,7 +571,7 @@ void MFRC522::PCD_AntennaOff() {
  * @return Value of the RxGain, scrubbed to the 3 bits used.
  */
 byte MFRC522::PCD_GetAntennaGain() {
-	return PCD_ReadRegister(RFCfgReg) & (0x07<<4);
+	return PCD_ReadShadowedRegister(RFCfgReg) & (0x07<<4);
 } // End PCD_GetAntennaGain()
 
 /**
@@ -461,6 +730,7 @@ MFRC522::StatusCode MFRC522::PCD_TransceiveData(	byte *sendData,		///< Pointer t
 /**
  * Transfers data to the MFRC522 FIFO, executes a command, waits for completion and transfers data back from the FIFO.
  * CRC validation can only be done if backData and backLen are specified.
+ * Loading the FIFO and reading the response take one SPI bus transaction each; the bus is free while the PICC answers.
  *
  * @return STATUS_OK on success, STATUS_??? otherwise.
  */
@@ -483,19 +753,7 @@ MFRC522::StatusCode MFRC522::PCD_CommunicateWithPICC(	byte command,		///< The co
 	for (int i = 0; i < sendLen; i++) Serial.print(sendData[i], HEX), Serial.print(" ");
 	Serial.println();
 	
-	// Prepare values for BitFramingReg
-	byte txLastBits = validBits ? *validBits : 0;
-	byte bitFraming = (rxAlign << 4) + txLastBits;		// RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
-	
-	PCD_WriteRegister(CommandReg, PCD_Idle);			// Stop any active command.
-	PCD_WriteRegister(ComIrqReg, 0x7F);					// Clear all seven interrupt request bits
-	PCD_WriteRegister(FIFOLevelReg, 0x80);				// FlushBuffer = 1, FIFO initialization
-	PCD_WriteRegister(FIFODataReg, sendLen, sendData);	// Write sendData to the FIFO
-	PCD_WriteRegister(BitFramingReg, bitFraming);		// Bit adjustments
-	PCD_WriteRegister(CommandReg, command);				// Execute the command
-	if (command == PCD_Transceive) {
-		PCD_SetRegisterBitMask(BitFramingReg, 0x80);	// StartSend=1, transmission of data starts
-	}
+	PCD_StartCommunication(command, sendData, sendLen, validBits ? *validBits : 0, rxAlign);
 	
 	// In PCD_Init() we set the TAuto flag in TModeReg. This means the timer
 	// automatically starts when the PCD stops transmitting.
@@ -533,29 +791,79 @@ MFRC522::StatusCode MFRC522::PCD_CommunicateWithPICC(	byte command,		///< The co
 		return STATUS_TIMEOUT;
 	}
 	
-	// Stop now if any errors except collisions were detected.
+	return PCD_FinishCommunication(backData, backLen, validBits, rxAlign, checkCRC);
+} // End PCD_CommunicateWithPICC()
+
+/**
+ * Loads the FIFO and starts a command. Shared by the blocking and the asynchronous communication functions.
+ * All register writes share one bus transaction.
+ */
+void MFRC522::PCD_StartCommunication(	byte command,		///< The command to execute. One of the PCD_Command enums.
+										byte *sendData,		///< Pointer to the data to transfer to the FIFO.
+										byte sendLen,		///< Number of bytes to transfer to the FIFO.
+										byte txLastBits,	///< The number of valid bits in the last transmitted byte. 0 for 8 valid bits.
+										byte rxAlign		///< Defines the bit position in backData[0] for the first bit received.
+									) {
+	// Prepare values for BitFramingReg
+	byte bitFraming = (rxAlign << 4) + txLastBits;		// RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
+	PCD_BusLock bus(*this);
+	
+	const PCD_RegisterWrite prepare[] = {
+		{ CommandReg,		PCD_Idle },					// Stop any active command.
+		{ ComIrqReg,		0x7F },						// Clear all seven interrupt request bits
+		{ FIFOLevelReg,		0x80 }						// FlushBuffer = 1, FIFO initialization
+	};
+	const PCD_RegisterWrite execute[] = {
+		{ BitFramingReg,	bitFraming },				// Bit adjustments
+		{ CommandReg,		command },					// Execute the command
+		{ BitFramingReg,	(byte)(bitFraming | 0x80) }	// StartSend=1, transmission of data starts. Only sent for PCD_Transceive.
+	};
+	PCD_WriteRegisters(prepare, sizeof(prepare) / sizeof(prepare[0]));
+	PCD_WriteRegister(FIFODataReg, sendLen, sendData);	// Write sendData to the FIFO
+	PCD_WriteRegisters(execute, command == PCD_Transceive ? 3 : 2);
+} // End PCD_StartCommunication()
+
+/**
+ * Checks ErrorReg and transfers the response from the FIFO once the command signalled completion.
+ * Shared by the blocking and the asynchronous communication functions. The register reads share one bus transaction;
+ * the bus is released before the debug output and the CRC check, whose coprocessor wait must not hold it.
+ *
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::PCD_FinishCommunication(	byte *backData,		///< nullptr or pointer to buffer if data should be read back after executing the command.
+														byte *backLen,		///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
+														byte *validBits,	///< Out: The number of valid bits in the last byte. 0 for 8 valid bits.
+														byte rxAlign,		///< In: Defines the bit position in backData[0] for the first bit received.
+														bool checkCRC		///< In: True => The last two bytes of the response is assumed to be a CRC_A that must be validated.
+													) {
+	PCD_BusLock bus(*this);
 	byte errorRegValue = PCD_ReadRegister(ErrorReg); // ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
-	Serial.print(F("ErrorReg: 0x")); Serial.println(errorRegValue, HEX);
+	byte n = 0;
+	byte _validBits = 0;
+	// If the caller wants data back and no error stops us below, get it from the MFRC522.
+	if (!(errorRegValue & 0x13) && backData && backLen) {
+		n = PCD_ReadRegister(FIFOLevelReg);						// Number of bytes in the FIFO
+		if (n <= *backLen) {
+			PCD_ReadRegister(FIFODataReg, n, backData, rxAlign);	// Get received data from FIFO
+			_validBits = PCD_ReadRegister(ControlReg) & 0x07;	// RxLastBits[2:0] indicates the number of valid bits in the last received byte. If this value is 000b, the whole byte is valid.
+		}
+	}
+	bus.Release();
 	
+	// Stop now if any errors except collisions were detected.
+	Serial.print(F("ErrorReg: 0x")); Serial.println(errorRegValue, HEX);
 	if (errorRegValue & 0x13) {	 // BufferOvfl ParityErr ProtocolErr
 		Serial.println(F("ERROR: Buffer overflow, parity error, or protocol error"));
 		return STATUS_ERROR;
 	}
-  
-	byte _validBits = 0;
 	
-	// If the caller wants data back, get it from the MFRC522.
 	if (backData && backLen) {
-		byte n = PCD_ReadRegister(FIFOLevelReg);	// Number of bytes in the FIFO
 		Serial.print(F("FIFO bytes available: ")); Serial.println(n);
-		
 		if (n > *backLen) {
 			Serial.println(F("ERROR: Not enough room in backData buffer"));
 			return STATUS_NO_ROOM;
 		}
 		*backLen = n;											// Number of bytes returned
-		PCD_ReadRegister(FIFODataReg, n, backData, rxAlign);	// Get received data from FIFO
-		_validBits = PCD_ReadRegister(ControlReg) & 0x07;		// RxLastBits[2:0] indicates the number of valid bits in the last received byte. If this value is 000b, the whole byte is valid.
 		if (validBits) {
 			*validBits = _validBits;
 		}
@@ -605,7 +913,7 @@ MFRC522::StatusCode MFRC522::PCD_CommunicateWithPICC(	byte command,		///< The co
 	
 	Serial.println(F("=== PCD_CommunicateWithPICC END ==="));
 	return STATUS_OK;
-} // End PCD_CommunicateWithPICC()
+} // End PCD_FinishCommunication()
 
 /**
  * Transmits a REQuest command, Type A. Invites PICCs in state IDLE to go to READY and prepare for anticollision or selection. 7 bit frame.
@@ -975,6 +1283,246 @@ MFRC522::StatusCode MFRC522::PICC_HaltA() {
 	return result;
 } // End PICC_HaltA()
 
+/**
+ * Checks whether a PICC selected before is still in the field, without REQA and the ANTICOLLISION loop.
+ * A PICC that is ACTIVE ignores REQA (and falls back to IDLE), so instead it is sent to HALT with HLTA and
+ * woken with WUPA; a PICC halted by the caller skips the first step silently. The MFRC522 timer is
+ * shortened to 1ms meanwhile: HLTA is acknowledged by 1ms of silence and ATQA/SAK follow within 0.1ms.
+ * With reselect the PICC is selected again with the known UID, which also proves it is the same PICC,
+ * and it is ACTIVE (not authenticated) on return. Without it only the ATQA is checked and the PICC is left
+ * READY; the next frame other than SELECT sends it back to HALT.
+ * 
+ * @return STATUS_OK if the PICC answered, STATUS_TIMEOUT if it has left the field, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::PICC_CheckPresence(	Uid *uid,		///< The UID of the PICC, uid->size must be set. Only used with reselect.
+													bool reselect	///< true to leave the PICC ACTIVE again
+												) {
+	MFRC522::StatusCode status;
+	byte bufferATQA[2];
+	byte bufferSize = sizeof(bufferATQA);
+	
+	// 0x0028 = 40 periods of 25μs. The TReloadReg shadow makes saving the old value free.
+	byte reloadH = PCD_ReadShadowedRegister(TReloadRegH);
+	byte reloadL = PCD_ReadShadowedRegister(TReloadRegL);
+	const PCD_RegisterWrite shortTimeout[] = { { TReloadRegH, 0x00 }, { TReloadRegL, 0x28 } };
+	PCD_WriteRegisters(shortTimeout, 2);
+	
+	PCD_StopCrypto1();						// HLTA must be sent in plain text
+	status = PICC_HaltA();
+	if (status == STATUS_OK) {
+		status = PICC_WakeupA(bufferATQA, &bufferSize);
+	}
+	if (status == STATUS_OK && reselect) {
+		status = PICC_SelectKnownUid(*uid);
+	}
+	
+	const PCD_RegisterWrite restoreTimeout[] = { { TReloadRegH, reloadH }, { TReloadRegL, reloadL } };
+	PCD_WriteRegisters(restoreTimeout, 2);
+	return status;
+} // End PICC_CheckPresence()
+
+/**
+ * Brings a PICC with a known UID from HALT (or IDLE) back to ACTIVE: WUPA, then one SELECT per cascade level.
+ * Unlike PICC_Select() there is no ANTICOLLISION round, the CRC_A of the SELECT and SAK frames is computed on the
+ * host instead of by the CRC coprocessor, and uid is not modified. Typical use is re-selecting a PICC after
+ * PICC_HaltA() or a failed authentication; a PICC still ACTIVE ignores WUPA and falls back, see PICC_CheckPresence().
+ * 
+ * @return STATUS_OK on success, STATUS_TIMEOUT if the PICC is gone, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::PICC_Reselect(	const Uid &uid	///< The UID of the PICC, as filled in by PICC_Select().
+										) {
+	byte bufferATQA[2];
+	byte bufferSize = sizeof(bufferATQA);
+	MFRC522::StatusCode status = PICC_WakeupA(bufferATQA, &bufferSize);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	return PICC_SelectKnownUid(uid);
+} // End PICC_Reselect()
+
+/**
+ * Sends a SELECT with all UID bits for every cascade level of uid to the PICC in state READY.
+ * 
+ * @return STATUS_OK when the PICC is ACTIVE, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::PICC_SelectKnownUid(	const Uid &uid	///< The UID of the PICC, uid.size must be 4, 7 or 10.
+												) {
+	if (uid.size != 4 && uid.size != 7 && uid.size != 10) {
+		return STATUS_INVALID;
+	}
+	byte levels = uid.size == 4 ? 1 : (uid.size == 7 ? 2 : 3);
+	byte buffer[9];					// SEL, NVB, 4 UID bytes or CT + 3 UID bytes, BCC, CRC_A
+	byte sak[3];					// SAK + CRC_A
+	
+	for (byte level = 0; level < levels; level++) {
+		bool cascade = level + 1 < levels;	// The UID continues on the next cascade level
+		buffer[0] = PICC_CMD_SEL_CL1 + 2 * level;	// SEL_CL1, SEL_CL2, SEL_CL3
+		buffer[1] = 0x70;					// NVB: seven whole bytes, this is a SELECT
+		if (cascade) {
+			buffer[2] = PICC_CMD_CT;
+			memcpy(&buffer[3], &uid.uidByte[3 * level], 3);
+		} else {
+			memcpy(&buffer[2], &uid.uidByte[3 * level], 4);
+		}
+		buffer[6] = buffer[2] ^ buffer[3] ^ buffer[4] ^ buffer[5];	// BCC
+		CalculateCRC_A(buffer, 7, &buffer[7]);
+		
+		byte sakSize = sizeof(sak);
+		byte validBits = 0;
+		MFRC522::StatusCode status = PCD_TransceiveData(buffer, sizeof(buffer), sak, &sakSize, &validBits);
+		if (status != STATUS_OK) {
+			return status;
+		}
+		if (sakSize != 3 || validBits != 0) {	// SAK must be exactly 24 bits
+			return STATUS_ERROR;
+		}
+		byte crc[2];
+		CalculateCRC_A(sak, 1, crc);
+		if (sak[1] != crc[0] || sak[2] != crc[1]) {
+			return STATUS_CRC_WRONG;
+		}
+		if (((sak[0] & 0x04) != 0) != cascade) {	// The cascade bit must agree with uid.size
+			return STATUS_ERROR;
+		}
+	}
+	return STATUS_OK;
+} // End PICC_SelectKnownUid()
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Asynchronous (interrupt driven) communication with PICCs
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Tells the library which Arduino pin is wired to the MFRC522 IRQ output.
+ * While an asynchronous exchange is in flight PCD_PollAsync() then only touches the SPI bus
+ * once the IRQ line is asserted. Without an IRQ pin PCD_PollAsync() falls back to reading ComIrqReg.
+ */
+void MFRC522::PCD_SetIrqPin(	byte irqPin	///< Arduino pin connected to MFRC522's IRQ output (Pin 23). UNUSED_PIN to poll ComIrqReg instead.
+							) {
+	_irqPin = irqPin;
+	if (_irqPin != UNUSED_PIN) {
+		pinMode(_irqPin, INPUT_PULLUP);
+	}
+} // End PCD_SetIrqPin()
+
+/**
+ * Marks the IRQ line as asserted. Safe to call from an interrupt service routine attached to the IRQ pin.
+ * The exchange itself is completed by the next PCD_PollAsync() call.
+ */
+void MFRC522::PCD_HandleIrq() {
+	_irqPending = true;
+} // End PCD_HandleIrq()
+
+#ifndef MFRC522_NO_ASYNC
+/**
+ * Starts a command like PCD_CommunicateWithPICC() but returns as soon as the command is running.
+ * The interrupt sources of waitIRq and TimerIRq are routed to the IRQ pin (ComIEnReg), call PCD_PollAsync()
+ * from loop() until it returns false. The callback is invoked from PCD_PollAsync() with the final status.
+ * backData, backLen and validBits must stay valid until the callback has run.
+ *
+ * @return STATUS_OK if the command was started, STATUS_??? otherwise (the callback is not invoked in that case).
+ */
+MFRC522::StatusCode MFRC522::PCD_CommunicateWithPICCAsync(	PCD_AsyncCallback callback,	///< Function to call on completion. May be nullptr.
+															void *context,				///< Passed unchanged to the callback.
+															byte command,				///< The command to execute. One of the PCD_Command enums.
+															byte waitIRq,				///< The bits in the ComIrqReg register that signals successful completion of the command.
+															byte *sendData,				///< Pointer to the data to transfer to the FIFO.
+															byte sendLen,				///< Number of bytes to transfer to the FIFO.
+															byte *backData,				///< nullptr or pointer to buffer if data should be read back after executing the command.
+															byte *backLen,				///< In: Max number of bytes to write to *backData. Out: The number of bytes returned.
+															byte *validBits,			///< In/Out: The number of valid bits in the last byte. 0 for 8 valid bits.
+															byte rxAlign,				///< In: Defines the bit position in backData[0] for the first bit received. Default 0.
+															bool checkCRC				///< In: True => The last two bytes of the response is assumed to be a CRC_A that must be validated.
+														) {
+	if (_async.active) {
+		return STATUS_INVALID; // Only one exchange can be in flight per reader.
+	}
+	PICC_DisarmPresencePoll();	// Now, so the interrupt enables it restores do not replace the ones below
+	
+	_async.waitIRq		= waitIRq;
+	_async.backData		= backData;
+	_async.backLen		= backLen;
+	_async.validBits	= validBits;
+	_async.rxAlign		= rxAlign;
+	_async.checkCRC		= checkCRC;
+	_async.callback		= callback;
+	_async.context		= context;
+	_irqPending			= false;
+	
+	// ComIEnReg[7..0] bits are: IRqInv TxIEn RxIEn IdleIEn HiAlertIEn LoAlertIEn ErrIEn TimerIEn
+	// IRqInv=1 keeps the IRQ pin active low, as after reset.
+	PCD_WriteRegister(ComIEnReg, 0x80 | (waitIRq & 0x7F) | 0x01);
+	_async.divIEn		= PCD_ReadShadowedRegister(DivIEnReg);	// Restored by PCD_CompleteAsync() and PCD_CancelAsync()
+	PCD_WriteRegister(DivIEnReg, 0x80);		// IRQPushPull=1, the IRQ pin is driven in both directions
+	PCD_StartCommunication(command, sendData, sendLen, validBits ? *validBits : 0, rxAlign);
+	
+	// Same ~36ms guard as PCD_CommunicateWithPICC() in case the IRQ never fires.
+	_async.start		= millis();
+	_async.active		= true;
+	return STATUS_OK;
+} // End PCD_CommunicateWithPICCAsync()
+
+/**
+ * Advances an asynchronous exchange. Call it once per loop() iteration.
+ * With an IRQ pin configured the SPI bus is only used once the MFRC522 asserts IRQ (or PCD_HandleIrq() was called).
+ *
+ * @return true while the exchange is still in flight, false once it has completed (or none was started).
+ */
+bool MFRC522::PCD_PollAsync() {
+	if (!_async.active) {
+		return false;
+	}
+	
+	bool irqAsserted = true;
+	if (_irqPin != UNUSED_PIN) {
+		irqAsserted = _irqPending || digitalRead(_irqPin) == LOW;
+	}
+	if (irqAsserted) {
+		_irqPending = false;
+		byte n = PCD_ReadRegister(ComIrqReg);	// ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
+		if (n & _async.waitIRq) {				// One of the interrupts that signal success has been set.
+			PCD_CompleteAsync(PCD_FinishCommunication(_async.backData, _async.backLen, _async.validBits, _async.rxAlign, _async.checkCRC));
+			return false;
+		}
+		if (n & 0x01) {							// Timer interrupt - nothing received in 25ms
+			PCD_CompleteAsync(STATUS_TIMEOUT);
+			return false;
+		}
+	}
+	if (static_cast<uint32_t> (millis()) - _async.start >= 36) {	// Unsigned difference, correct across the millis() wraparound
+		PCD_CompleteAsync(STATUS_TIMEOUT);
+		return false;
+	}
+	return true;
+} // End PCD_PollAsync()
+
+/**
+ * Aborts an asynchronous exchange without invoking its callback.
+ */
+void MFRC522::PCD_CancelAsync() {
+	if (!_async.active) {
+		return;
+	}
+	PCD_WriteRegister(CommandReg, PCD_Idle);	// Stop any active command.
+	PCD_WriteRegister(ComIEnReg, 0x80);			// Disable all interrupt sources again
+	PCD_WriteRegister(DivIEnReg, _async.divIEn);
+	_async.active = false;
+} // End PCD_CancelAsync()
+
+/**
+ * Releases the IRQ line and reports the result of the asynchronous exchange.
+ */
+void MFRC522::PCD_CompleteAsync(	StatusCode status	///< Final status passed to the callback.
+								) {
+	PCD_WriteRegister(ComIEnReg, 0x80);			// Disable all interrupt sources again, IRQ returns to inactive
+	PCD_WriteRegister(DivIEnReg, _async.divIEn);	// IRQ pin driver as before the exchange
+	_async.active = false;						// Cleared first so the callback may start the next exchange.
+	if (_async.callback) {
+		_async.callback(status, _async.context);
+	}
+} // End PCD_CompleteAsync()
+#endif // MFRC522_NO_ASYNC
+
 /////////////////////////////////////////////////////////////////////////////////////
 // Functions for communicating with MIFARE PICCs
 /////////////////////////////////////////////////////////////////////////////////////
@@ -1066,6 +1614,145 @@ MFRC522::StatusCode MFRC522::MIFARE_Read(	byte blockAddr, 	///< MIFARE Classic:
 	return PCD_TransceiveData(buffer, 4, buffer, bufferSize, nullptr, 0, true);
 } // End MIFARE_Read()
 
+/**
+ * Reads all blocks (sector trailer included) of one MIFARE Classic sector with a single authentication.
+ * The blocks are stored lowest address first, 16 bytes each: 64 bytes for sectors 0..31, 256 bytes for sectors 32..39.
+ * 
+ * Crypto1 stays active afterwards, like after PCD_Authenticate(). Call PCD_StopCrypto1() when done with the PICC.
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::MIFARE_ReadSector(	byte command,					///< PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+												byte sector,					///< The sector to read, 0..39.
+												MIFARE_Key *key,				///< The key for the sector
+												Uid *uid,						///< Pointer to Uid struct returned from a successful PICC_Select().
+												byte *buffer,					///< The buffer to store the blocks in
+												uint16_t *bufferSize,			///< In: size of buffer. Out: number of bytes stored, also on failure.
+												MIFARE_SectorTiming *timing		///< nullptr or where to store the timing of the sector
+											) {
+	MFRC522::StatusCode status;
+	byte firstBlock;
+	byte blockCount;
+	uint16_t capacity = *bufferSize;
+	
+	*bufferSize = 0;
+	if (!MIFARE_GetSectorLayout(sector, &firstBlock, &blockCount)) {
+		return STATUS_INVALID;
+	}
+	if (buffer == nullptr || capacity < blockCount * 16) {
+		return STATUS_NO_ROOM;
+	}
+	
+	uint32_t start = micros();
+	status = PCD_Authenticate(command, firstBlock, key, uid);
+	uint32_t authenticated = micros();
+	for (byte i = 0; i < blockCount && status == STATUS_OK; i++) {
+		status = MIFARE_ReadBlockInSession(firstBlock + i, &buffer[*bufferSize]);
+		if (status == STATUS_OK) {
+			*bufferSize += 16;
+		}
+	}
+	
+	if (timing) {
+		timing->sector		= sector;
+		timing->status		= status;
+		timing->authMicros	= authenticated - start;
+		timing->readMicros	= micros() - authenticated;
+	}
+	return status;
+} // End MIFARE_ReadSector()
+
+/**
+ * Reads sectorCount consecutive MIFARE Classic sectors with MIFARE_ReadSector(), one authentication per sector.
+ * The sectors are stored back to back in buffer. Reading stops at the first sector that fails.
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::MIFARE_ReadRange(	byte command,					///< PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+												byte firstSector,				///< The first sector to read, 0..39.
+												byte sectorCount,				///< The number of sectors to read.
+												MIFARE_Key *key,				///< The key for all sectors
+												Uid *uid,						///< Pointer to Uid struct returned from a successful PICC_Select().
+												byte *buffer,					///< The buffer to store the blocks in
+												uint16_t *bufferSize,			///< In: size of buffer. Out: number of bytes stored, also on failure.
+												MIFARE_SectorTiming *timings	///< nullptr or an array of sectorCount timings. Entries after a failed sector are not written.
+											) {
+	MFRC522::StatusCode status = STATUS_OK;
+	uint16_t capacity = *bufferSize;
+	
+	*bufferSize = 0;
+	if (buffer == nullptr) {
+		return STATUS_NO_ROOM;
+	}
+	for (byte i = 0; i < sectorCount && status == STATUS_OK; i++) {
+		uint16_t sectorSize = capacity - *bufferSize;
+		status = MIFARE_ReadSector(command, firstSector + i, key, uid, &buffer[*bufferSize], &sectorSize, timings ? &timings[i] : nullptr);
+		*bufferSize += sectorSize;
+	}
+	return status;
+} // End MIFARE_ReadRange()
+
+/**
+ * Returns the address of the first block and the number of blocks of a MIFARE Classic sector.
+ * Sectors 0..31 have 4 blocks, sectors 32..39 (MIFARE Classic 4K only) have 16 blocks.
+ * 
+ * @return false if the sector does not exist on any MIFARE Classic PICC.
+ */
+bool MFRC522::MIFARE_GetSectorLayout(	byte sector,		///< The sector, 0..39.
+										byte *firstBlock,	///< Out: address of the first block in the sector
+										byte *blockCount	///< Out: number of blocks in the sector, sector trailer included
+									) {
+	if (sector < 32) {
+		*blockCount = 4;
+		*firstBlock = sector * 4;
+	}
+	else if (sector < 40) {
+		*blockCount = 16;
+		*firstBlock = 128 + (sector - 32) * 16;
+	}
+	else {
+		return false;
+	}
+	return true;
+} // End MIFARE_GetSectorLayout()
+
+/**
+ * Reads one block of an authenticated sector for MIFARE_ReadSector().
+ * Same exchange as MIFARE_Read(), but the CRC_A of the command and of the response are computed on the host,
+ * which saves two round trips through the CRC coprocessor per block.
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522::MIFARE_ReadBlockInSession(	byte blockAddr,	///< The block (0-0xff) number.
+														byte *buffer	///< Where to store the 16 data bytes
+													) {
+	MFRC522::StatusCode result;
+	byte frame[18];
+	byte frameSize = sizeof(frame);
+	byte validBits = 0;
+	byte crc[2];
+	
+	frame[0] = PICC_CMD_MF_READ;
+	frame[1] = blockAddr;
+	CalculateCRC_A(frame, 2, &frame[2]);
+	result = PCD_TransceiveData(frame, 4, frame, &frameSize, &validBits);
+	if (result != STATUS_OK) {
+		return result;
+	}
+	if (frameSize == 1 && validBits == 4) {		// MIFARE Classic NAK
+		return STATUS_MIFARE_NACK;
+	}
+	if (frameSize != 18 || validBits != 0) {
+		return STATUS_CRC_WRONG;
+	}
+	CalculateCRC_A(frame, 16, crc);
+	if (frame[16] != crc[0] || frame[17] != crc[1]) {
+		return STATUS_CRC_WRONG;
+	}
+	memcpy(buffer, frame, 16);
+	return STATUS_OK;
+} // End MIFARE_ReadBlockInSession()
+
 /**
  * Writes 16 bytes to the active PICC.
  * 
@@ -1118,6 +1805,7 @@ MFRC522::StatusCode MFRC522::MIFARE_Write(	byte blockAddr, ///< MIFARE Classic:
 	return STATUS_OK;
 } // End MIFARE_Write()
 
+#ifndef MFRC522_NO_ULTRALIGHT
 /**
  * Writes a 4 byte page to the active MIFARE Ultralight PICC.
  * 
@@ -1147,6 +1835,7 @@ MFRC522::StatusCode MFRC522::MIFARE_Ultralight_Write(	byte page, 		///< The page
 	}
 	return STATUS_OK;
 } // End MIFARE_Ultralight_Write()
+#endif // MFRC522_NO_ULTRALIGHT
 
 /**
  * MIFARE Decrement subtracts the delta from the value of the addressed block, and stores the result in a volatile memory.
@@ -1299,6 +1988,7 @@ MFRC522::StatusCode MFRC522::MIFARE_SetValue(byte blockAddr, int32_t value) {
 	return MIFARE_Write(blockAddr, buffer, 16);
 } // End MIFARE_SetValue()
 
+#ifndef MFRC522_NO_NTAG
 /**
  * Authenticate with a NTAG216.
  * 
@@ -1343,6 +2033,7 @@ MFRC522::StatusCode MFRC522::PCD_NTAG216_AUTH(byte* passWord, byte pACK[]) //Aut
 	
 	return STATUS_OK;
 } // End PCD_NTAG216_AUTH()
+#endif // MFRC522_NO_NTAG
 
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -1425,11 +2116,16 @@ MFRC522::StatusCode MFRC522::PCD_MIFARE_Transceive(	byte *sendData,		///< Pointe
 
 /**
  * Returns a __FlashStringHelper pointer to a status code name.
+ * With MFRC522_NO_NAMES every code is named "?".
  * 
  * @return const __FlashStringHelper *
  */
 const __FlashStringHelper *MFRC522::GetStatusCodeName(MFRC522::StatusCode code	///< One of the StatusCode enums.
 										) {
+#ifdef MFRC522_NO_NAMES
+	(void)code;
+	return F("?");
+#else
 	switch (code) {
 		case STATUS_OK:				return F("Success.");
 		case STATUS_ERROR:			return F("Error in communication.");
@@ -1442,6 +2138,7 @@ const __FlashStringHelper *MFRC522::GetStatusCodeName(MFRC522::StatusCode code	/
 		case STATUS_MIFARE_NACK:	return F("A MIFARE PICC responded with NAK.");
 		default:					return F("Unknown error");
 	}
+#endif
 } // End GetStatusCodeName()
 
 /**
@@ -1473,11 +2170,16 @@ MFRC522::PICC_Type MFRC522::PICC_GetType(byte sak		///< The SAK byte returned fr
 
 /**
  * Returns a __FlashStringHelper pointer to the PICC type name.
+ * With MFRC522_NO_NAMES every type is named "?".
  * 
  * @return const __FlashStringHelper *
  */
 const __FlashStringHelper *MFRC522::PICC_GetTypeName(PICC_Type piccType	///< One of the PICC_Type enums.
 													) {
+#ifdef MFRC522_NO_NAMES
+	(void)piccType;
+	return F("?");
+#else
 	switch (piccType) {
 		case PICC_TYPE_ISO_14443_4:		return F("PICC compliant with ISO/IEC 14443-4");
 		case PICC_TYPE_ISO_18092:		return F("PICC compliant with ISO/IEC 18092 (NFC)");
@@ -1492,8 +2194,11 @@ const __FlashStringHelper *MFRC522::PICC_GetTypeName(PICC_Type piccType	///< One
 		case PICC_TYPE_UNKNOWN:
 		default:						return F("Unknown type");
 	}
+#endif
 } // End PICC_GetTypeName()
 
+#ifndef MFRC522_NO_DUMP
+
 /**
  * Dumps debug info about the connected PCD to Serial.
  * Shows all known firmware versions
@@ -1542,9 +2247,11 @@ void MFRC522::PICC_DumpToSerial(Uid *uid	///< Pointer to Uid struct returned fro
 			PICC_DumpMifareClassicToSerial(uid, piccType, &key);
 			break;
 			
+#ifndef MFRC522_NO_ULTRALIGHT
 		case PICC_TYPE_MIFARE_UL:
 			PICC_DumpMifareUltralightToSerial();
 			break;
+#endif
 			
 		case PICC_TYPE_ISO_14443_4:
 		case PICC_TYPE_MIFARE_DESFIRE:
@@ -1782,6 +2489,7 @@ void MFRC522::PICC_DumpMifareClassicSectorToSerial(Uid *uid,			///< Pointer to U
 	return;
 } // End PICC_DumpMifareClassicSectorToSerial()
 
+#ifndef MFRC522_NO_ULTRALIGHT
 /**
  * Dumps memory contents of a MIFARE Ultralight PICC.
  */
@@ -1823,6 +2531,8 @@ void MFRC522::PICC_DumpMifareUltralightToSerial() {
 		}
 	}
 } // End PICC_DumpMifareUltralightToSerial()
+#endif // MFRC522_NO_ULTRALIGHT
+#endif // MFRC522_NO_DUMP
 
 /**
  * Calculates the bit pattern needed for the specified access bits. In the [C1 C2 C3] tuples C1 is MSB (=4) and C3 is LSB (=1).
@@ -1843,6 +2553,7 @@ void MFRC522::MIFARE_SetAccessBits(	byte *accessBitBuffer,	///< Pointer to byte
 } // End MIFARE_SetAccessBits()
 
 
+#ifndef MFRC522_NO_BACKDOOR
 /**
  * Performs the "magic sequence" needed to get Chinese UID changeable
  * Mifare cards to allow writing to sector 0, where the card UID is stored.
@@ -2042,6 +2753,170 @@ bool MFRC522::MIFARE_UnbrickUidSector(bool logErrors) {
 	}
 	return true;
 }
+#endif // MFRC522_NO_BACKDOOR
+
+/**
+ * Searches the keys of MIFARE Classic sectors in a key list (dictionary).
+ * A failed authentication sends the PICC to HALT, so before the next attempt the PICC is re-activated with
+ * the shortest sequence, PICC_Reselect(): WUPA and a SELECT per cascade level with the known UID, no ANTICOLLISION.
+ * With MFRC522_KEY_CACHE_SIZE > 0 found keys are cached per UID and tried first next time, see MIFARE_ClearKeyCache().
+ * While searching, the MFRC522 timer is shortened to 5ms because the PICC answers an authentication within
+ * a few hundred μs; the 25ms from PCD_Init() would dominate the time per failed attempt.
+ * 
+ * The PICC must be ACTIVE (selected with PICC_Select()) when calling this function. When it returns STATUS_OK
+ * the PICC is authenticated for the last sector in which a key was found, or ACTIVE if none was found.
+ * Call PCD_StopCrypto1() when done.
+ * 
+ * @return STATUS_OK when the search ran over all sectors (check results[].found), STATUS_??? if the PICC was lost.
+ */
+MFRC522::StatusCode MFRC522::MIFARE_FindKeys(	byte command,					///< PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+												Uid *uid,						///< Pointer to Uid struct returned from a successful PICC_Select().
+												const MIFARE_Key *keys,			///< The keys to try, in order
+												byte keyCount,					///< Number of keys
+												byte firstSector,				///< The first sector to search, 0..39.
+												byte sectorCount,				///< The number of sectors to search.
+												MIFARE_SectorKey *results,		///< Array of sectorCount results
+												MIFARE_KeySearchStats *stats	///< nullptr or where to store the statistics of the search
+											) {
+	MFRC522::StatusCode status = STATUS_OK;
+	MIFARE_KeySearchStats counters = {0, 0, 0, 0, 0};
+	MIFARE_Key key;
+	Uid card = *uid;			// PICC_Select() with a known UID writes it back, keep the caller's copy untouched
+	bool halted = false;		// true after a failed authentication
+	byte firstBlock;
+	byte blockCount;
+	uint32_t start = micros();
+	
+	// Shorten the timeout for MFAuthent, see above. 0x00C8 = 200 periods of 25μs.
+	byte reloadH = PCD_ReadRegister(TReloadRegH);
+	byte reloadL = PCD_ReadRegister(TReloadRegL);
+	const PCD_RegisterWrite shortTimeout[] = { { TReloadRegH, 0x00 }, { TReloadRegL, 0xC8 } };
+	PCD_WriteRegisters(shortTimeout, 2);
+	
+	for (byte i = 0; i < sectorCount && status == STATUS_OK; i++) {
+		byte sector = firstSector + i;
+		results[i].sector = sector;
+		results[i].found = false;
+		if (!MIFARE_GetSectorLayout(sector, &firstBlock, &blockCount)) {
+			continue;
+		}
+		
+		// Candidate -1 is the cached key, if any
+#if MFRC522_KEY_CACHE_SIZE > 0
+		bool cached = MIFARE_GetCachedKey(&card, command, sector, &key);
+#else
+		bool cached = false;
+#endif
+		for (int16_t candidate = cached ? -1 : 0; candidate < keyCount; candidate++) {
+			if (candidate >= 0) {
+				key = keys[candidate];
+			}
+			if (halted) {
+				status = PICC_Reselect(card);
+				counters.reactivations++;
+				if (status != STATUS_OK) {
+					break;		// The PICC left the field
+				}
+				halted = false;
+			}
+			counters.attempts++;
+			if (PCD_Authenticate(command, firstBlock, &key, &card) == STATUS_OK) {
+				results[i].found = true;
+				results[i].key = key;
+				if (candidate < 0) {
+					counters.cacheHits++;
+				}
+#if MFRC522_KEY_CACHE_SIZE > 0
+				else {
+					MIFARE_CacheKey(&card, command, sector, &key);
+				}
+#endif
+				break;
+			}
+			PCD_StopCrypto1();
+			halted = true;
+		}
+	}
+	
+	// Leave the PICC ACTIVE, as it was passed in, if the last attempt failed.
+	if (halted && status == STATUS_OK) {
+		status = PICC_Reselect(card);
+		counters.reactivations++;
+	}
+	const PCD_RegisterWrite restoreTimeout[] = { { TReloadRegH, reloadH }, { TReloadRegL, reloadL } };
+	PCD_WriteRegisters(restoreTimeout, 2);
+	
+	if (stats) {
+		counters.micros = micros() - start;
+		counters.attemptsPerSecond = counters.micros ? (uint32_t)((uint64_t)counters.attempts * 1000000 / counters.micros) : 0;
+		*stats = counters;
+	}
+	return status;
+} // End MIFARE_FindKeys()
+
+/**
+ * Forgets all keys found by MIFARE_FindKeys(). Does nothing with MFRC522_KEY_CACHE_SIZE 0.
+ */
+void MFRC522::MIFARE_ClearKeyCache() {
+#if MFRC522_KEY_CACHE_SIZE > 0
+	_keyCacheUsed = 0;
+	_keyCacheNext = 0;
+#endif
+} // End MIFARE_ClearKeyCache()
+
+#if MFRC522_KEY_CACHE_SIZE > 0
+
+/**
+ * Looks up a key found earlier by MIFARE_FindKeys().
+ * 
+ * @return true if a key for the PICC and sector is in the cache.
+ */
+bool MFRC522::MIFARE_GetCachedKey(	Uid *uid,			///< The PICC
+									byte command,		///< PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+									byte sector,		///< The sector
+									MIFARE_Key *key		///< Out: the cached key
+								) {
+	uint32_t tag = UidTag(uid);
+	for (byte i = 0; i < _keyCacheUsed; i++) {
+		if (_keyCache[i].uidTag == tag && _keyCache[i].sector == sector && _keyCache[i].command == command) {
+			*key = _keyCache[i].key;
+			return true;
+		}
+	}
+	return false;
+} // End MIFARE_GetCachedKey()
+
+/**
+ * Remembers a key found by MIFARE_FindKeys(). When the cache is full the oldest entry is replaced.
+ */
+void MFRC522::MIFARE_CacheKey(	Uid *uid,				///< The PICC
+								byte command,			///< PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+								byte sector,			///< The sector
+								const MIFARE_Key *key	///< The key that authenticated the sector
+							) {
+	byte index;
+	uint32_t tag = UidTag(uid);
+	
+	for (index = 0; index < _keyCacheUsed; index++) {	// The key changed since it was cached: update in place
+		if (_keyCache[index].uidTag == tag && _keyCache[index].sector == sector && _keyCache[index].command == command) {
+			break;
+		}
+	}
+	if (index == _keyCacheUsed) {
+		if (_keyCacheUsed < MFRC522_KEY_CACHE_SIZE) {
+			_keyCacheUsed++;
+		}
+		else {
+			index = _keyCacheNext;
+			_keyCacheNext = (_keyCacheNext + 1) % MFRC522_KEY_CACHE_SIZE;
+		}
+	}
+	_keyCache[index].uidTag = tag;
+	_keyCache[index].sector = sector;
+	_keyCache[index].command = command;
+	_keyCache[index].key = *key;
+} // End MIFARE_CacheKey()
+#endif // MFRC522_KEY_CACHE_SIZE > 0
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Convenience functions - does not add extra functionality
@@ -2074,6 +2949,131 @@ bool MFRC522::PICC_IsNewCardPresent() {
 	return cardPresent;
 } // End PICC_IsNewCardPresent()
 
+/////////////////////////////////////////////////////////////////////////////////////
+// Low-overhead presence polling
+/////////////////////////////////////////////////////////////////////////////////////
+#ifndef MFRC522_NO_PRESENCE_POLL
+
+/**
+ * Sets the poll interval of PICC_PollNewCardPresent().
+ * After every REQA that stays unanswered the interval doubles, up to maxIntervalMs; it drops back to
+ * intervalMs once a PICC answers. maxIntervalMs <= intervalMs disables the back-off.
+ */
+void MFRC522::PICC_SetPresencePolling(	uint16_t intervalMs,	///< ms between polls, 0 to poll on every call
+										uint16_t maxIntervalMs	///< Longest interval the back-off reaches
+									) {
+	_presence.minInterval = intervalMs;
+	_presence.maxInterval = maxIntervalMs > intervalMs ? maxIntervalMs : intervalMs;
+	_presence.interval = intervalMs;
+} // End PICC_SetPresencePolling()
+
+/**
+ * Loads the REQA configuration and leaves the MFRC522 in PCD_Transceive, waiting for StartSend.
+ * The receiver settings are the ones PICC_IsNewCardPresent() writes on every call.
+ */
+void MFRC522::PICC_ArmPresencePoll() {
+	_presence.comIEn = PCD_ReadShadowedRegister(ComIEnReg);	// Restored by PICC_DisarmPresencePoll()
+	_presence.divIEn = PCD_ReadShadowedRegister(DivIEnReg);
+	PCD_ClearRegisterBitMask(CollReg, 0x80);		// ValuesAfterColl=1 => Bits received after collision are cleared.
+	const PCD_RegisterWrite arm[] = {
+		{ CommandReg,		PCD_Idle },				// Stop any active command.
+		{ TxModeReg,		0x00 },					// Reset baud rates
+		{ RxModeReg,		0x00 },
+		{ ModWidthReg,		0x26 },					// Reset ModWidthReg
+		{ ComIEnReg,		0xA0 },					// IRqInv=1, RxIEn=1: only a received frame asserts the IRQ pin
+		{ DivIEnReg,		0x80 },					// IRQPushPull=1, the IRQ pin is driven in both directions
+		{ FIFOLevelReg,		0x80 },					// FlushBuffer = 1, FIFO initialization
+		{ BitFramingReg,	0x07 },					// Short frame - transmit only 7 bits of the last (and only) byte.
+		{ CommandReg,		PCD_Transceive }		// Transmits each time StartSend is set
+	};
+	PCD_WriteRegisters(arm, sizeof(arm) / sizeof(arm[0]));
+	_presence.armed = true;
+} // End PICC_ArmPresencePoll()
+#endif // MFRC522_NO_PRESENCE_POLL
+
+/**
+ * Ends the presence poll: a REQA still waiting for its ATQA is dropped and ComIEnReg and DivIEnReg get back the
+ * values they had before PICC_ArmPresencePoll(), so the IRQ pin no longer reports received frames.
+ * Called by the first CommandReg access of any other function and when a poll found a PICC.
+ * Does nothing with MFRC522_NO_PRESENCE_POLL.
+ */
+void MFRC522::PICC_DisarmPresencePoll() {
+#ifndef MFRC522_NO_PRESENCE_POLL
+	if (!_presence.armed) {
+		return;
+	}
+	_presence.armed = false;						// First: the writes below come back through PCD_UpdateShadow()
+	_presence.waiting = false;
+	const PCD_RegisterWrite restore[] = {
+		{ ComIEnReg,	_presence.comIEn },
+		{ DivIEnReg,	_presence.divIEn }
+	};
+	PCD_WriteRegisters(restore, sizeof(restore) / sizeof(restore[0]));
+#endif // MFRC522_NO_PRESENCE_POLL
+} // End PICC_DisarmPresencePoll()
+
+#ifndef MFRC522_NO_PRESENCE_POLL
+/**
+ * Cheap replacement for PICC_IsNewCardPresent() in idle loops. It never waits: call it on every loop() iteration.
+ * Returns false without touching the bus until the poll interval (PICC_SetPresencePolling()) has elapsed.
+ * The first poll arms the MFRC522 for REQA; the following ones only send REQA (one SPI transaction) and return.
+ * The calls after that look for the ATQA once each, on the IRQ pin if PCD_SetIrqPin() configured one and with a
+ * single ComIrqReg read otherwise, until it arrived (true) or MFRC522_PRESENCE_WAIT_US have passed.
+ * A collision counts as present, as in PICC_IsNewCardPresent(). Any other command, e.g. the
+ * PICC_ReadCardSerial() that follows a true result, disarms it; the next poll arms it again.
+ * Do not mix it with asynchronous exchanges in flight.
+ *
+ * @return bool
+ */
+bool MFRC522::PICC_PollNewCardPresent() {
+#ifndef MFRC522_NO_ASYNC
+	if (_async.active) {
+		return false;
+	}
+#endif
+	
+	if (_presence.waiting) {
+		bool answered;
+		if (_irqPin != UNUSED_PIN) {
+			answered = _irqPending || digitalRead(_irqPin) == LOW;	// RxIRq is the only enabled source
+		} else {
+			answered = PCD_ReadRegister(ComIrqReg) & 0x20;			// RxIRq: ATQA (or a collision) received
+		}
+		if (answered) {
+			PICC_DisarmPresencePoll();				// IRQ returns to inactive, the next poll re-arms
+			_presence.interval = _presence.minInterval;
+			return true;
+		}
+		if (micros() - _presence.sent < MFRC522_PRESENCE_WAIT_US) {
+			return false;
+		}
+		_presence.waiting = false;
+		uint32_t interval = _presence.interval ? (uint32_t)_presence.interval * 2 : 1;
+		_presence.interval = interval < _presence.maxInterval ? interval : _presence.maxInterval;
+		return false;
+	}
+	
+	if (millis() - _presence.lastPoll < _presence.interval) {
+		return false;
+	}
+	_presence.lastPoll = millis();
+	if (!_presence.armed) {
+		PICC_ArmPresencePoll();
+	}
+	
+	const PCD_RegisterWrite request[] = {
+		{ ComIrqReg,		0x7F },					// Clear all seven interrupt request bits
+		{ FIFODataReg,		PICC_CMD_REQA },
+		{ BitFramingReg,	0x87 }					// StartSend=1, TxLastBits=7
+	};
+	_irqPending = false;
+	PCD_WriteRegisters(request, sizeof(request) / sizeof(request[0]));
+	_presence.sent = micros();
+	_presence.waiting = true;
+	return false;
+} // End PICC_PollNewCardPresent()
+#endif // MFRC522_NO_PRESENCE_POLL
+
 /**
  * Simple wrapper around PICC_Select.
  * Returns true if a UID could be read.
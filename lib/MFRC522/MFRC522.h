@@ -22,6 +22,27 @@
  #define MFRC522_SPICLOCK (4000000u)	// MFRC522 accept upto 10MHz, set to 4MHz.
  #endif
  
+ #ifndef MFRC522_KEY_CACHE_SIZE
+ #define MFRC522_KEY_CACHE_SIZE 0		// Sector keys remembered by MIFARE_FindKeys(), 12 bytes of RAM each per instance. 0: no cache.
+ #endif
+ 
+ #ifndef MFRC522_PRESENCE_WAIT_US
+ #define MFRC522_PRESENCE_WAIT_US 1000	// PICC_PollNewCardPresent() looks this long for the ATQA. REQA + FDT + ATQA take about 0.3ms.
+ #endif
+ 
+ // Optional features, left out by defining for the whole build (e.g. arduino-cli compile --build-property
+ // "compiler.cpp.extra_flags=-DMFRC522_NO_DUMP"); a #define in the sketch does not reach MFRC522.cpp.
+ //	MFRC522_NO_DUMP			PCD_DumpVersionToSerial() and the PICC_Dump...ToSerial() functions
+ //	MFRC522_NO_ULTRALIGHT	MIFARE_Ultralight_Write() and the Ultralight dump
+ //	MFRC522_NO_NTAG			PCD_NTAG216_AUTH()
+ //	MFRC522_NO_NAMES		The GetStatusCodeName() and PICC_GetTypeName() strings, both return "?"
+ //	MFRC522_NO_BACKDOOR		MIFARE_OpenUidBackdoor(), MIFARE_SetUid() and MIFARE_UnbrickUidSector()
+ // These also free RAM in every MFRC522 instance (AVR sizes):
+ //	MFRC522_NO_ASYNC			PCD_CommunicateWithPICCAsync() and the rest of its API, MFRC522Reader and MFRC522Bus. 19 bytes
+ //	MFRC522_NO_PRESENCE_POLL	PICC_SetPresencePolling(), PICC_PollNewCardPresent(). 18 bytes
+ //	MFRC522_NO_SHADOW		PCD_SetRegisterShadowed(); every register is read over SPI. 64 bytes
+ //	MFRC522_NO_BUS_STATS		PCD_GetBusStats(), PCD_ResetBusStats(). 8 bytes
+ 
  // Firmware data for self-test
  // Reference values based on firmware version
  // Hint: if needed, you can remove unused self-test data to save flash memory
@@ -262,6 +283,55 @@
    typedef struct {
      byte		keyByte[MF_KEY_SIZE];
    } MIFARE_Key;
+ 
+   // Result of one sector read by MIFARE_ReadSector() or MIFARE_ReadRange(). Times in microseconds.
+   typedef struct {
+     byte		sector;
+     StatusCode	status;
+     uint32_t	authMicros;		// PCD_Authenticate() for the sector
+     uint32_t	readMicros;		// All block reads of the sector
+   } MIFARE_SectorTiming;
+ 
+   // Key found by MIFARE_FindKeys() for one sector
+   typedef struct {
+     byte		sector;
+     bool		found;
+     MIFARE_Key	key;
+   } MIFARE_SectorKey;
+ 
+   // Statistics of a MIFARE_FindKeys() run
+   typedef struct {
+     uint16_t	attempts;			// Authentications tried
+     uint16_t	reactivations;		// WUPA + SELECT needed after failed authentications
+     uint16_t	cacheHits;			// Sectors opened with a key from the key cache
+     uint32_t	micros;				// Duration of the search
+     uint32_t	attemptsPerSecond;
+   } MIFARE_KeySearchStats;
+ 
+   // A register/value pair for PCD_WriteRegisters()
+   typedef struct {
+     PCD_Register	reg;
+     byte			value;
+   } PCD_RegisterWrite;
+   
+   // SPI bus usage counters, see PCD_GetBusStats()
+   typedef struct {
+     uint32_t	transactions;	// SPI.beginTransaction() calls
+     uint32_t	accesses;		// Register accesses, each one NSS low pulse
+   } PCD_BusStats;
+   
+   // Holds the SPI bus from construction until Release() or destruction, see PCD_BeginBus()
+   class PCD_BusLock {
+   public:
+     PCD_BusLock(MFRC522 &mfrc522) : _mfrc522(mfrc522), _held(true) { _mfrc522.PCD_BeginBus(); }
+     ~PCD_BusLock() { Release(); }
+     PCD_BusLock(const PCD_BusLock &) = delete;
+     PCD_BusLock &operator=(const PCD_BusLock &) = delete;
+     void Release() { if (_held) { _held = false; _mfrc522.PCD_EndBus(); } }
+   private:
+     MFRC522 &_mfrc522;
+     bool _held;
+   };
    
    // Member variables
    Uid uid;								// Used by PICC_ReadCardSerial().
@@ -278,11 +348,22 @@
    /////////////////////////////////////////////////////////////////////////////////////
    void PCD_WriteRegister(PCD_Register reg, byte value);
    void PCD_WriteRegister(PCD_Register reg, byte count, byte *values);
+   void PCD_WriteRegisters(const PCD_RegisterWrite *writes, byte count);
    byte PCD_ReadRegister(PCD_Register reg);
    void PCD_ReadRegister(PCD_Register reg, byte count, byte *values, byte rxAlign = 0);
    void PCD_SetRegisterBitMask(PCD_Register reg, byte mask);
    void PCD_ClearRegisterBitMask(PCD_Register reg, byte mask);
+ #ifndef MFRC522_NO_SHADOW
+   void PCD_SetRegisterShadowed(PCD_Register reg, bool shadowed);
+ #endif
+   void PCD_InvalidateShadow();
    StatusCode PCD_CalculateCRC(byte *data, byte length, byte *result);
+   void PCD_BeginBus();
+   void PCD_EndBus();
+ #ifndef MFRC522_NO_BUS_STATS
+   const PCD_BusStats &PCD_GetBusStats() const { return _busStats; }
+   void PCD_ResetBusStats();
+ #endif
    
    /////////////////////////////////////////////////////////////////////////////////////
    // Functions for manipulating the MFRC522
@@ -313,6 +394,23 @@
    StatusCode PICC_REQA_or_WUPA(byte command, byte *bufferATQA, byte *bufferSize);
    virtual StatusCode PICC_Select(Uid *uid, byte validBits = 0);
    StatusCode PICC_HaltA();
+   StatusCode PICC_CheckPresence(Uid *uid, bool reselect = true);
+   StatusCode PICC_Reselect(const Uid &uid);
+ 
+   /////////////////////////////////////////////////////////////////////////////////////
+   // Asynchronous (interrupt driven) communication with PICCs
+   /////////////////////////////////////////////////////////////////////////////////////
+   // Called once an asynchronous exchange has finished. backData/backLen/validBits passed to
+   // PCD_CommunicateWithPICCAsync() are filled in before the callback runs.
+   typedef void (*PCD_AsyncCallback)(StatusCode status, void *context);
+   void PCD_SetIrqPin(byte irqPin);
+   void PCD_HandleIrq();
+ #ifndef MFRC522_NO_ASYNC
+   StatusCode PCD_CommunicateWithPICCAsync(PCD_AsyncCallback callback, void *context, byte command, byte waitIRq, byte *sendData, byte sendLen, byte *backData = nullptr, byte *backLen = nullptr, byte *validBits = nullptr, byte rxAlign = 0, bool checkCRC = false);
+   bool PCD_PollAsync();
+   bool PCD_IsAsyncBusy() const { return _async.active; }
+   void PCD_CancelAsync();
+ #endif
  
    /////////////////////////////////////////////////////////////////////////////////////
    // Functions for communicating with MIFARE PICCs
@@ -320,15 +418,22 @@
    StatusCode PCD_Authenticate(byte command, byte blockAddr, MIFARE_Key *key, Uid *uid);
    void PCD_StopCrypto1();
    StatusCode MIFARE_Read(byte blockAddr, byte *buffer, byte *bufferSize);
+   StatusCode MIFARE_ReadSector(byte command, byte sector, MIFARE_Key *key, Uid *uid, byte *buffer, uint16_t *bufferSize, MIFARE_SectorTiming *timing = nullptr);
+   StatusCode MIFARE_ReadRange(byte command, byte firstSector, byte sectorCount, MIFARE_Key *key, Uid *uid, byte *buffer, uint16_t *bufferSize, MIFARE_SectorTiming *timings = nullptr);
+   static bool MIFARE_GetSectorLayout(byte sector, byte *firstBlock, byte *blockCount);
    StatusCode MIFARE_Write(byte blockAddr, byte *buffer, byte bufferSize);
+ #ifndef MFRC522_NO_ULTRALIGHT
    StatusCode MIFARE_Ultralight_Write(byte page, byte *buffer, byte bufferSize);
+ #endif
    StatusCode MIFARE_Decrement(byte blockAddr, int32_t delta);
    StatusCode MIFARE_Increment(byte blockAddr, int32_t delta);
    StatusCode MIFARE_Restore(byte blockAddr);
    StatusCode MIFARE_Transfer(byte blockAddr);
    StatusCode MIFARE_GetValue(byte blockAddr, int32_t *value);
    StatusCode MIFARE_SetValue(byte blockAddr, int32_t value);
+ #ifndef MFRC522_NO_NTAG
    StatusCode PCD_NTAG216_AUTH(byte *passWord, byte pACK[]);
+ #endif
    
    /////////////////////////////////////////////////////////////////////////////////////
    // Support functions
@@ -343,18 +448,26 @@
    static const __FlashStringHelper *PICC_GetTypeName(PICC_Type type);
    
    // Support functions for debuging
+ #ifndef MFRC522_NO_DUMP
    void PCD_DumpVersionToSerial();
    void PICC_DumpToSerial(Uid *uid);
    void PICC_DumpDetailsToSerial(Uid *uid);
    void PICC_DumpMifareClassicToSerial(Uid *uid, PICC_Type piccType, MIFARE_Key *key);
    void PICC_DumpMifareClassicSectorToSerial(Uid *uid, MIFARE_Key *key, byte sector);
+ #ifndef MFRC522_NO_ULTRALIGHT
    void PICC_DumpMifareUltralightToSerial();
+ #endif
+ #endif
    
    // Advanced functions for MIFARE
    void MIFARE_SetAccessBits(byte *accessBitBuffer, byte g0, byte g1, byte g2, byte g3);
+ #ifndef MFRC522_NO_BACKDOOR
    bool MIFARE_OpenUidBackdoor(bool logErrors);
    bool MIFARE_SetUid(byte *newUid, byte uidSize, bool logErrors);
    bool MIFARE_UnbrickUidSector(bool logErrors);
+ #endif
+   StatusCode MIFARE_FindKeys(byte command, Uid *uid, const MIFARE_Key *keys, byte keyCount, byte firstSector, byte sectorCount, MIFARE_SectorKey *results, MIFARE_KeySearchStats *stats = nullptr);
+   void MIFARE_ClearKeyCache();
    
    /////////////////////////////////////////////////////////////////////////////////////
    // Convenience functions - does not add extra functionality
@@ -362,10 +475,109 @@
    virtual bool PICC_IsNewCardPresent();
    virtual bool PICC_ReadCardSerial();
    
+   /////////////////////////////////////////////////////////////////////////////////////
+   // Low-overhead presence polling
+   /////////////////////////////////////////////////////////////////////////////////////
+ #ifndef MFRC522_NO_PRESENCE_POLL
+   void PICC_SetPresencePolling(uint16_t intervalMs, uint16_t maxIntervalMs = 0);
+   bool PICC_PollNewCardPresent();
+   uint16_t PICC_GetPresenceInterval() const { return _presence.interval; }
+ #endif
+   
  protected:
    byte _chipSelectPin;		// Arduino pin connected to MFRC522's SPI slave select input (Pin 24, NSS, active low)
+ #ifdef __AVR__
+   volatile uint8_t *_chipSelectPort;	// Output register of _chipSelectPin, nullptr: use digitalWrite(), see PCD_ChipSelect()
+   uint8_t _chipSelectMask;			// Bit of _chipSelectPin in *_chipSelectPort
+ #endif
+   SPISettings _spiSettings;	// Bus settings of every register access, built once by the constructor
+   byte _busDepth;				// Nesting depth of PCD_BeginBus(), SPI.beginTransaction() is active while > 0
+ #ifndef MFRC522_NO_BUS_STATS
+   PCD_BusStats _busStats;
+ #endif
    byte _resetPowerDownPin;	// Arduino pin connected to MFRC522's reset and power down input (Pin 6, NRSTPD, active low)
+   byte _irqPin;				// Arduino pin connected to MFRC522's IRQ output (Pin 23, active low), UNUSED_PIN if not wired
+   volatile bool _irqPending;	// Set by PCD_HandleIrq(), typically from an ISR attached to _irqPin
+ 
+ #ifndef MFRC522_NO_ASYNC
+   // State of the asynchronous exchange started by PCD_CommunicateWithPICCAsync()
+   struct {
+     bool				active;
+     byte				waitIRq;
+     byte				*backData;
+     byte				*backLen;
+     byte				*validBits;
+     byte				rxAlign;
+     bool				checkCRC;
+     byte				divIEn;			// DivIEnReg before the exchange
+     uint32_t			start;			// millis() when the command was started
+     PCD_AsyncCallback	callback;
+     void				*context;
+   } _async;
+ #endif
+ 
+ #ifndef MFRC522_NO_PRESENCE_POLL
+   // State of PICC_PollNewCardPresent(). While armed the MFRC522 stays in PCD_Transceive with the REQA framing
+   // loaded, so a poll only clears ComIrqReg, writes REQA to the FIFO and sets StartSend.
+   struct {
+     bool				armed;			// Cleared by every CommandReg access of the other functions
+     bool				waiting;		// A REQA was sent, the next polls look for the ATQA
+     byte				comIEn;			// ComIEnReg and DivIEnReg before PICC_ArmPresencePoll()
+     byte				divIEn;
+     uint32_t			sent;			// micros() of the last REQA
+     uint16_t			minInterval;	// ms between polls after a PICC was found
+     uint16_t			maxInterval;	// Upper limit of the back-off
+     uint16_t			interval;		// Current interval, doubled after every unanswered REQA up to maxInterval
+     uint32_t			lastPoll;		// millis() of the last REQA
+   } _presence;
+ #endif
+ 
+ #ifndef MFRC522_NO_SHADOW
+   // Shadow copies of configuration registers, indexed by register address (PCD_Register >> 1).
+   // Only registers the MFRC522 never changes by itself may be shadowed, see PCD_SetRegisterShadowed().
+   byte _shadowed[8];			// Bit n & 7 of byte n >> 3 set: register n is shadowed
+   byte _shadowValid[8];		// Same layout, set: _shadow[n] holds the value last written to / read from register n
+   byte _shadow[0x30];			// Registers 0x30..0x3F (test registers) are never shadowed
+ #endif
+ 
+   void PCD_SetChipSelectPin(byte chipSelectPin);
+   void PCD_ChipSelect(bool selected);
+   byte PCD_ReadShadowedRegister(PCD_Register reg);
+   void PCD_UpdateShadow(PCD_Register reg, byte value);
+   void PCD_CountAccesses(byte count) {	// Register accesses for PCD_GetBusStats()
+ #ifndef MFRC522_NO_BUS_STATS
+     _busStats.accesses += count;
+ #else
+     (void)count;
+ #endif
+   }
+   void PCD_StartCommunication(byte command, byte *sendData, byte sendLen, byte txLastBits, byte rxAlign);
+   StatusCode PCD_FinishCommunication(byte *backData, byte *backLen, byte *validBits, byte rxAlign, bool checkCRC);
+ #ifndef MFRC522_NO_ASYNC
+   void PCD_CompleteAsync(StatusCode status);
+ #endif
+ #ifndef MFRC522_NO_PRESENCE_POLL
+   void PICC_ArmPresencePoll();
+ #endif
+   void PICC_DisarmPresencePoll();
    StatusCode MIFARE_TwoStepHelper(byte command, byte blockAddr, int32_t data);
+   StatusCode MIFARE_ReadBlockInSession(byte blockAddr, byte *buffer);
+ 
+ #if MFRC522_KEY_CACHE_SIZE > 0
+   // Keys found by MIFARE_FindKeys(). A PICC is identified by the last 4 UID bytes, the ones PCD_Authenticate() uses.
+   struct {
+     uint32_t	uidTag;
+     byte		sector;
+     byte		command;
+     MIFARE_Key	key;
+   } _keyCache[MFRC522_KEY_CACHE_SIZE];
+   byte _keyCacheUsed;			// Valid entries in _keyCache
+   byte _keyCacheNext;			// Entry replaced next once the cache is full
+ 
+   bool MIFARE_GetCachedKey(Uid *uid, byte command, byte sector, MIFARE_Key *key);
+   void MIFARE_CacheKey(Uid *uid, byte command, byte sector, const MIFARE_Key *key);
+ #endif
+   StatusCode PICC_SelectKnownUid(const Uid &uid);
  };
  
  #endif
\ No newline at end of file
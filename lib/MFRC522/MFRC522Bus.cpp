@@ -0,0 +1,91 @@
+/*
+ * Round-robin scheduler for several MFRC522 readers on one SPI bus.
+ * NOTE: Please also check the comments in MFRC522Bus.h
+*/
+
+#include "MFRC522Bus.h"
+
+#ifndef MFRC522_NO_ASYNC
+
+/**
+ * Constructor.
+ */
+MFRC522Bus::MFRC522Bus() {
+	_count = 0;
+	_next = 0;
+} // End MFRC522Bus()
+
+/**
+ * Adds a reader to the round-robin. Its MFRC522 must use its own CS pin and be initialised with PCD_Init().
+ *
+ * @return false if MFRC522BUS_MAX_READERS readers are already scheduled.
+ */
+bool MFRC522Bus::AddReader(	MFRC522Reader &reader	///< The reader to schedule
+						) {
+	if (_count >= MFRC522BUS_MAX_READERS) {
+		return false;
+	}
+	_slots[_count].reader = &reader;
+	_slots[_count].lastVisit = 0;
+	_slots[_count].requestStart = 0;
+	memset(&_slots[_count].stats, 0, sizeof(ReaderStats));
+	_count++;
+	return true;
+} // End AddReader()
+
+/**
+ * Clears the statistics of all readers.
+ */
+void MFRC522Bus::ResetStats() {
+	for (byte i = 0; i < _count; i++) {
+		memset(&_slots[i].stats, 0, sizeof(ReaderStats));
+	}
+} // End ResetStats()
+
+/**
+ * Advances the next reader in round-robin order by one MFRC522Reader::Step(). Call it once per loop() iteration.
+ * A reader is served every GetReaderCount() calls, so a Step() costs no more than the Step() of a single reader.
+ *
+ * @return The event of the served reader, EVENT_NONE most of the time.
+ */
+MFRC522Reader::Event MFRC522Bus::Step(	byte *readerIndex	///< nullptr or where to store the index of the served reader
+									) {
+	if (_count == 0) {
+		return MFRC522Reader::EVENT_NONE;
+	}
+	byte index = _next;
+	_next = (_next + 1) % _count;
+
+	MFRC522Reader &reader = *_slots[index].reader;
+	ReaderStats &stats = _slots[index].stats;
+	uint32_t now = micros();
+	if (stats.visits) {
+		stats.lastServiceMicros = now - _slots[index].lastVisit;
+		if (stats.lastServiceMicros > stats.maxServiceMicros) {
+			stats.maxServiceMicros = stats.lastServiceMicros;
+		}
+	}
+	stats.visits++;
+	_slots[index].lastVisit = now;
+
+	MFRC522Reader::State before = reader.GetState();
+	MFRC522Reader::Event event = reader.Step();
+	if (before == MFRC522Reader::STATE_IDLE && reader.GetState() == MFRC522Reader::STATE_REQUEST) {
+		_slots[index].requestStart = now;
+	}
+	if (event == MFRC522Reader::EVENT_CARD_SELECTED) {
+		stats.lastDetectMicros = micros() - _slots[index].requestStart;
+		if (stats.lastDetectMicros > stats.maxDetectMicros) {
+			stats.maxDetectMicros = stats.lastDetectMicros;
+		}
+	}
+	if (reader.GetLastStepMicros() > stats.maxStepMicros) {
+		stats.maxStepMicros = reader.GetLastStepMicros();
+	}
+
+	if (readerIndex) {
+		*readerIndex = index;
+	}
+	return event;
+} // End Step()
+#endif // MFRC522_NO_ASYNC
@@ -0,0 +1,64 @@
+/**
+ * Round-robin scheduler for several MFRC522 readers on one SPI bus (separate CS lines).
+ * Each Step() advances one MFRC522Reader. Because the readers send REQA/WUPA/HLTA asynchronously, the RF wait of
+ * one reader overlaps the SPI traffic of the others; with an IRQ pin per reader (PCD_SetIrqPin()) a waiting reader
+ * does not use the bus at all until its MFRC522 asserts IRQ. Not available with MFRC522_NO_ASYNC.
+ *
+ * Typical use:
+ * 		MFRC522 mfrc522[2] = { MFRC522(10, 9), MFRC522(8, 9) };
+ * 		MFRC522Reader readers[2] = { MFRC522Reader(mfrc522[0]), MFRC522Reader(mfrc522[1]) };
+ * 		MFRC522Bus bus;
+ * 		...
+ * 		void loop() {
+ * 			byte index;
+ * 			if (bus.Step(&index) == MFRC522Reader::EVENT_CARD_SELECTED) {
+ * 				// bus.GetReader(index) has selected a PICC
+ * 			}
+ * 		}
+ */
+#ifndef MFRC522Bus_h
+#define MFRC522Bus_h
+
+#include <Arduino.h>
+#include "MFRC522Reader.h"
+
+#ifndef MFRC522BUS_MAX_READERS
+#define MFRC522BUS_MAX_READERS 8
+#endif
+
+#ifndef MFRC522_NO_ASYNC
+class MFRC522Bus {
+public:
+	// Polling statistics of one reader, in microseconds
+	typedef struct {
+		uint32_t	visits;					// Step() calls that served this reader
+		uint32_t	lastServiceMicros;		// Time between the last two visits
+		uint32_t	maxServiceMicros;
+		uint32_t	lastDetectMicros;		// From the start of the REQA that found a PICC to EVENT_CARD_SELECTED
+		uint32_t	maxDetectMicros;
+		uint32_t	maxStepMicros;			// Longest MFRC522Reader::Step() of this reader
+	} ReaderStats;
+
+	MFRC522Bus();
+
+	bool AddReader(MFRC522Reader &reader);
+	MFRC522Reader::Event Step(byte *readerIndex = nullptr);
+
+	byte GetReaderCount() const { return _count; }
+	MFRC522Reader &GetReader(byte index) { return *_slots[index].reader; }
+	const ReaderStats &GetStats(byte index) const { return _slots[index].stats; }
+	void ResetStats();
+
+protected:
+	struct {
+		MFRC522Reader	*reader;
+		uint32_t		lastVisit;			// micros() of the last visit
+		uint32_t		requestStart;		// micros() when the current REQA was started
+		ReaderStats	stats;
+	} _slots[MFRC522BUS_MAX_READERS];
+	byte _count;
+	byte _next;							// Reader served by the next Step()
+};
+#endif // MFRC522_NO_ASYNC
+
+#endif
@@ -980,6 +980,7 @@ MFRC522::PICC_Type MFRC522Extended::PICC_GetType(TagInfo *tag		///< The TagInfo
 	}
 } // End PICC_GetType()
 
+#ifndef MFRC522_NO_DUMP
 /**
  * Dumps debug info about the selected PICC to Serial.
  * On success the PICC is halted after dumping the data.
@@ -1005,9 +1006,11 @@ void MFRC522Extended::PICC_DumpToSerial(TagInfo *tag)
 			PICC_DumpMifareClassicToSerial(&tag->uid, piccType, &key);
 			break;
 		
+#ifndef MFRC522_NO_ULTRALIGHT
 		case PICC_TYPE_MIFARE_UL:
 			PICC_DumpMifareUltralightToSerial();
 			break;
+#endif
 		
 		case PICC_TYPE_ISO_14443_4:
 		case PICC_TYPE_MIFARE_DESFIRE:
@@ -1088,6 +1091,7 @@ void MFRC522Extended::PICC_DumpISO14443_4(TagInfo *tag)
 	}
 	
 } // End PICC_DumpISO14443_4
+#endif // MFRC522_NO_DUMP
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Convenience functions - does not add extra functionality
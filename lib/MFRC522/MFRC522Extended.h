@@ -104,11 +104,13 @@
      using MFRC522::PICC_GetType;// // make old PICC_GetType(byte sak) available, otherwise would be hidden by PICC_GetType(TagInfo *tag)
  
      // Support functions for debuging
+ #ifndef MFRC522_NO_DUMP
      void PICC_DumpToSerial(TagInfo *tag);
      using MFRC522::PICC_DumpToSerial; // make old PICC_DumpToSerial(Uid *uid) available, otherwise would be hidden by PICC_DumpToSerial(TagInfo *tag)
      void PICC_DumpDetailsToSerial(TagInfo *tag);
      using MFRC522::PICC_DumpDetailsToSerial; // make old PICC_DumpDetailsToSerial(Uid *uid) available, otherwise would be hidden by PICC_DumpDetailsToSerial(TagInfo *tag)
      void PICC_DumpISO14443_4(TagInfo *tag);
+ #endif
      
      /////////////////////////////////////////////////////////////////////////////////////
      // Convenience functions - does not add extra functionality
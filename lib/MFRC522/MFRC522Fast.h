@@ -0,0 +1,100 @@
+/**
+ * MFRC522 with the chip select pin fixed at compile time.
+ * On AVR MFRC522 drives NSS through the output register and bit it looked up for the pin when it was constructed,
+ * with interrupts disabled around the read-modify-write (see PCD_ChipSelect()); all library functions use that.
+ * MFRC522Fast<CS_PIN, RST_PIN> goes one step further for the register accesses made directly from the sketch: it
+ * resolves CS_PIN to its port and bit mask when the sketch is compiled, so on the ATmega328P/168 (Uno, Nano, Pro Mini)
+ * and the ATmega2560 (Mega) PCD_WriteRegister(reg, value), PCD_ReadRegister(reg) and PCD_WriteRegisters() toggle NSS
+ * with single sbi/cbi instructions. On other boards MFRC522Fast is the same as MFRC522.
+ *
+ * Typical use, instead of MFRC522 mfrc522(10, 9):
+ * 		MFRC522Fast<10, 9> mfrc522;
+ *
+ * The constant accesses hide the MFRC522 ones and are resolved at compile time, so they only apply to calls made on
+ * the MFRC522Fast object itself, not through a MFRC522 reference; the library functions (PCD_Init(), PICC_*,
+ * MIFARE_*) are compiled once in MFRC522.cpp and use the chip select of MFRC522. Everything else is the MFRC522
+ * interface. PCD_Init(chipSelectPin, resetPowerDownPin) must not be used to move the chip select to another pin.
+ */
+ #ifndef MFRC522Fast_h
+ #define MFRC522Fast_h
+ 
+ #include <Arduino.h>
+ #include "MFRC522.h"
+ 
+ #if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__) || defined(__AVR_ATmega2560__)
+ #define MFRC522FAST_CONSTANT_PORT
+ #endif
+ 
+ // Port and bit of an Arduino pin as compile time constants, for the boards whose pin mapping is fixed
+ template <byte PIN>
+ struct MFRC522FastPin {
+ #if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+   static_assert(PIN < 20, "MFRC522Fast: no such pin on this board");
+   // Digital pins 0-7 PORTD, 8-13 PORTB, 14-19 (A0-A5) PORTC
+   static volatile uint8_t &Port() { return PIN < 8 ? PORTD : (PIN < 14 ? PORTB : PORTC); }
+   static constexpr uint8_t mask = 1 << (PIN < 8 ? PIN : (PIN < 14 ? PIN - 8 : PIN - 14));
+ #elif defined(__AVR_ATmega2560__)
+   static_assert(PIN == 10 || PIN == 53 || (PIN >= 22 && PIN <= 29) || (PIN >= 30 && PIN <= 37),
+                 "MFRC522Fast: use pin 10, 22-37 or 53 on the Mega, or MFRC522");
+   // Pin 10 PB4, 53 PB0 (SS), 22-29 PA0-PA7, 30-37 PC7-PC0
+   static volatile uint8_t &Port() { return PIN == 10 || PIN == 53 ? PORTB : (PIN < 30 ? PORTA : PORTC); }
+   static constexpr uint8_t mask = 1 << (PIN == 10 ? 4 : (PIN == 53 ? 0 : (PIN < 30 ? PIN - 22 : 37 - PIN)));
+ #endif
+ };
+ 
+ template <byte CS_PIN, byte RST_PIN = UINT8_MAX>
+ class MFRC522Fast : public MFRC522 {
+ public:
+   MFRC522Fast() : MFRC522(CS_PIN, RST_PIN) {}
+ 
+ #ifdef MFRC522FAST_CONSTANT_PORT
+   // The other PCD_WriteRegister() and PCD_ReadRegister() overloads stay those of MFRC522
+   using MFRC522::PCD_WriteRegister;
+   using MFRC522::PCD_ReadRegister;
+ 
+   void PCD_WriteRegister(PCD_Register reg, byte value) {
+     PCD_BeginBus();
+     Select();
+     SPI.transfer(reg);					// MSB == 0 is for writing. LSB is not used in address. Datasheet section 8.1.2.3.
+     SPI.transfer(value);
+     Deselect();
+     PCD_EndBus();
+     PCD_CountAccesses(1);
+     PCD_UpdateShadow(reg, value);
+   }
+ 
+   byte PCD_ReadRegister(PCD_Register reg) {
+     PCD_BeginBus();
+     Select();
+     SPI.transfer(0x80 | reg);			// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
+     byte value = SPI.transfer(0);		// Read the value back. Send 0 to stop reading.
+     Deselect();
+     PCD_EndBus();
+     PCD_CountAccesses(1);
+     PCD_UpdateShadow(reg, value);
+     return value;
+   }
+ 
+   void PCD_WriteRegisters(const PCD_RegisterWrite *writes, byte count) {
+     PCD_BeginBus();
+     for (byte index = 0; index < count; index++) {
+       Select();
+       SPI.transfer(writes[index].reg);
+       SPI.transfer(writes[index].value);
+       Deselect();						// NSS high ends the write to writes[index].reg
+     }
+     PCD_EndBus();
+     PCD_CountAccesses(count);
+     for (byte index = 0; index < count; index++) {
+       PCD_UpdateShadow(writes[index].reg, writes[index].value);
+     }
+   }
+ 
+ private:
+   // Constant port and mask: the compiler emits cbi/sbi, which cannot be torn by an interrupt
+   static void Select() { MFRC522FastPin<CS_PIN>::Port() &= (uint8_t)~MFRC522FastPin<CS_PIN>::mask; }
+   static void Deselect() { MFRC522FastPin<CS_PIN>::Port() |= MFRC522FastPin<CS_PIN>::mask; }
+ #endif
+ };
+ 
+ #endif
@@ -0,0 +1,213 @@
+/*
+ * Non-blocking card detection for loop() based firmware.
+ * NOTE: Please also check the comments in MFRC522Reader.h
+*/
+
+#include "MFRC522Reader.h"
+
+#ifndef MFRC522_NO_ASYNC
+
+/**
+ * Constructor.
+ * The MFRC522 must have been initialised with PCD_Init() before the first Step().
+ */
+MFRC522Reader::MFRC522Reader(	MFRC522 &mfrc522	///< Reader driven by this state machine. Do not use it for other exchanges while Step() has one in flight.
+							) : _mfrc522(mfrc522) {
+	_pollInterval		= 50;
+	_presenceInterval	= 250;
+	_missThreshold		= 2;
+	_state				= STATE_IDLE;
+	_misses				= 0;
+	_lastPoll			= 0;
+	_atqa[0]			= 0;
+	_atqa[1]			= 0;
+	_atqaSize			= 0;
+	_validBits			= 0;
+	_asyncDone			= false;
+	_asyncStatus		= MFRC522::STATUS_OK;
+	_lastStatus			= MFRC522::STATUS_OK;
+	ResetStats();
+} // End MFRC522Reader()
+
+/**
+ * Aborts any exchange in flight and returns to STATE_IDLE. The next Step() polls immediately.
+ */
+void MFRC522Reader::Reset() {
+	_mfrc522.PCD_CancelAsync();
+	_state		= STATE_IDLE;
+	_misses		= 0;
+	_lastPoll	= millis() - _pollInterval;
+} // End Reset()
+
+/**
+ * Clears the Step() latency statistics.
+ */
+void MFRC522Reader::ResetStats() {
+	_lastStepMicros	= 0;
+	_maxStepMicros	= 0;
+	_maxStepState	= STATE_IDLE;
+	_stepCount		= 0;
+} // End ResetStats()
+
+/**
+ * Advances the state machine by at most one bus exchange. Call it once per loop() iteration.
+ * After EVENT_CARD_SELECTED the PICC stays ACTIVE until the first presence check, i.e. for SetPresenceInterval() ms.
+ * Work on the PICC (authentication, reads, ...) should be done right after the event.
+ *
+ * @return The event produced by this step, EVENT_NONE most of the time.
+ */
+MFRC522Reader::Event MFRC522Reader::Step() {
+	State state = _state;
+	uint32_t start = micros();
+	Event event = StepState();
+	uint32_t elapsed = micros() - start;
+
+	_lastStepMicros = elapsed;
+	_stepCount++;
+	if (elapsed > _maxStepMicros) {
+		_maxStepMicros = elapsed;
+		_maxStepState = state;
+	}
+	return event;
+} // End Step()
+
+/**
+ * One transition of the state machine. Split from Step() so the latency bookkeeping stays in one place.
+ */
+MFRC522Reader::Event MFRC522Reader::StepState() {
+	switch (_state) {
+		case STATE_IDLE:
+			if (millis() - _lastPoll < _pollInterval) {
+				return EVENT_NONE;
+			}
+			_lastPoll = millis();
+			// Reset baud rates and ModWidthReg, as PICC_IsNewCardPresent() does
+			_mfrc522.PCD_WriteRegister(MFRC522::TxModeReg, 0x00);
+			_mfrc522.PCD_WriteRegister(MFRC522::RxModeReg, 0x00);
+			_mfrc522.PCD_WriteRegister(MFRC522::ModWidthReg, 0x26);
+			if (StartRequest(MFRC522::PICC_CMD_REQA) == MFRC522::STATUS_OK) {
+				_state = STATE_REQUEST;
+			}
+			return EVENT_NONE;
+
+		case STATE_REQUEST:
+			if (_mfrc522.PCD_PollAsync() || !_asyncDone) {
+				return EVENT_NONE;
+			}
+			if (!AtqaValid(_asyncStatus)) {
+				_state = STATE_IDLE;
+				return EVENT_NONE;
+			}
+			_state = STATE_SELECT;
+			return EVENT_CARD_ARRIVED;
+
+		case STATE_SELECT:
+			// The PICC has just answered, so PICC_Select() only blocks for the few ms of the anticollision loop.
+			_lastStatus = _mfrc522.PICC_Select(&_mfrc522.uid);
+			if (_lastStatus != MFRC522::STATUS_OK) {
+				_state = STATE_IDLE;
+				return EVENT_SELECT_FAILED;
+			}
+			_state		= STATE_PRESENT;
+			_misses		= 0;
+			_lastPoll	= millis();
+			return EVENT_CARD_SELECTED;
+
+		case STATE_PRESENT:
+			if (millis() - _lastPoll < _presenceInterval) {
+				return EVENT_NONE;
+			}
+			_lastPoll = millis();
+			// The application may have left an authenticated session open; HLTA must be sent in plain text.
+			_mfrc522.PCD_StopCrypto1();
+			if (StartHalt() == MFRC522::STATUS_OK) {
+				_state = STATE_CHECK_HALT;
+			}
+			return EVENT_NONE;
+
+		case STATE_CHECK_HALT:
+			// A PICC acknowledges HLTA by not answering, so the result does not matter.
+			if (_mfrc522.PCD_PollAsync() || !_asyncDone) {
+				return EVENT_NONE;
+			}
+			if (StartRequest(MFRC522::PICC_CMD_WUPA) == MFRC522::STATUS_OK) {
+				_state = STATE_CHECK_WAKE;
+			} else {
+				_state = STATE_PRESENT;
+			}
+			return EVENT_NONE;
+
+		case STATE_CHECK_WAKE:
+			if (_mfrc522.PCD_PollAsync() || !_asyncDone) {
+				return EVENT_NONE;
+			}
+			_state = STATE_PRESENT;
+			if (AtqaValid(_asyncStatus)) {
+				_misses = 0;
+				return EVENT_NONE;
+			}
+			if (++_misses < _missThreshold) {
+				return EVENT_NONE;
+			}
+			_state = STATE_IDLE;
+			return EVENT_CARD_LEFT;
+	}
+	return EVENT_NONE;
+} // End StepState()
+
+/**
+ * Starts a REQA or WUPA short frame, like PICC_REQA_or_WUPA() but without waiting for the ATQA.
+ *
+ * @return STATUS_OK if the frame was sent, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522Reader::StartRequest(	byte command	///< PICC_CMD_REQA or PICC_CMD_WUPA
+												) {
+	_mfrc522.PCD_ClearRegisterBitMask(MFRC522::CollReg, 0x80);	// ValuesAfterColl=1 => Bits received after collision are cleared.
+	_command[0]	= command;
+	_atqaSize	= sizeof(_atqa);
+	_validBits	= 7;											// Short frame - transmit only 7 bits of the last (and only) byte.
+	_asyncDone	= false;
+	return _mfrc522.PCD_CommunicateWithPICCAsync(OnAsyncDone, this, MFRC522::PCD_Transceive, 0x30, _command, 1, _atqa, &_atqaSize, &_validBits);
+} // End StartRequest()
+
+/**
+ * Starts a HLTA frame, like PICC_HaltA() but without waiting for the timeout that acknowledges it.
+ *
+ * @return STATUS_OK if the frame was sent, STATUS_??? otherwise.
+ */
+MFRC522::StatusCode MFRC522Reader::StartHalt() {
+	MFRC522::StatusCode status;
+
+	_command[0] = MFRC522::PICC_CMD_HLTA;
+	_command[1] = 0;
+	status = _mfrc522.PCD_CalculateCRC(_command, 2, &_command[2]);
+	if (status != MFRC522::STATUS_OK) {
+		return status;
+	}
+	_asyncDone = false;
+	return _mfrc522.PCD_CommunicateWithPICCAsync(OnAsyncDone, this, MFRC522::PCD_Transceive, 0x30, _command, 4);
+} // End StartHalt()
+
+/**
+ * Checks the result of a REQA/WUPA exchange the same way PICC_REQA_or_WUPA() and PICC_IsNewCardPresent() do.
+ */
+bool MFRC522Reader::AtqaValid(	MFRC522::StatusCode status	///< Final status of the exchange
+							) const {
+	if (status == MFRC522::STATUS_COLLISION) {	// Several PICCs answered, PICC_Select() resolves it.
+		return true;
+	}
+	return status == MFRC522::STATUS_OK && _atqaSize == 2 && _validBits == 0;	// ATQA must be exactly 16 bits.
+} // End AtqaValid()
+
+/**
+ * Completion callback passed to PCD_CommunicateWithPICCAsync().
+ */
+void MFRC522Reader::OnAsyncDone(	MFRC522::StatusCode status,	///< Final status of the exchange
+									void *context				///< The MFRC522Reader that started it
+								) {
+	MFRC522Reader *reader = static_cast<MFRC522Reader *>(context);
+	reader->_asyncStatus	= status;
+	reader->_lastStatus		= status;
+	reader->_asyncDone		= true;
+} // End OnAsyncDone()
+#endif // MFRC522_NO_ASYNC
@@ -0,0 +1,100 @@
+/**
+ * Non-blocking card detection for loop() based firmware.
+ * MFRC522Reader wraps a MFRC522 instance in a small state machine: every call of Step() performs at most one
+ * bus exchange and returns immediately while the MFRC522 waits for the PICC. REQA, WUPA and HLTA, the frames
+ * that usually end in a timeout, are sent with PCD_CommunicateWithPICCAsync(); only PICC_Select() is blocking
+ * and it is only run once a PICC has answered. Not available with MFRC522_NO_ASYNC.
+ *
+ * Typical use:
+ * 		void loop() {
+ * 			switch (reader.Step()) {
+ * 				case MFRC522Reader::EVENT_CARD_SELECTED:	// mfrc522.uid is valid, the PICC is ACTIVE
+ * 					...
+ * 					break;
+ * 				case MFRC522Reader::EVENT_CARD_LEFT:
+ * 					...
+ * 					break;
+ * 				default:
+ * 					break;
+ * 			}
+ * 			// other work
+ * 		}
+ */
+ #ifndef MFRC522Reader_h
+ #define MFRC522Reader_h
+ 
+ #include <Arduino.h>
+ #include "MFRC522.h"
+ 
+ #ifndef MFRC522_NO_ASYNC
+ class MFRC522Reader {
+ public:
+   enum State : byte {
+     STATE_IDLE				= 0,	// No PICC, waiting for the next poll
+     STATE_REQUEST			= 1,	// REQA in flight
+     STATE_SELECT			= 2,	// A PICC answered REQA, PICC_Select() runs on the next Step()
+     STATE_PRESENT			= 3,	// PICC selected, waiting for the next presence check
+     STATE_CHECK_HALT		= 4,	// Presence check: HLTA in flight
+     STATE_CHECK_WAKE		= 5		// Presence check: WUPA in flight
+   };
+ 
+   enum Event : byte {
+     EVENT_NONE				= 0,
+     EVENT_CARD_ARRIVED		= 1,	// A new PICC answered REQA (ATQA in GetAtqa())
+     EVENT_CARD_SELECTED	= 2,	// PICC_Select() succeeded, mfrc522.uid holds the UID
+     EVENT_SELECT_FAILED	= 3,	// PICC_Select() failed, status in GetLastStatus()
+     EVENT_CARD_LEFT		= 4		// The selected PICC stopped answering WUPA
+   };
+ 
+   MFRC522Reader(MFRC522 &mfrc522);
+ 
+   Event Step();
+   void Reset();
+ 
+   void SetPollInterval(uint16_t ms) { _pollInterval = ms; }
+   void SetPresenceInterval(uint16_t ms) { _presenceInterval = ms; }
+   void SetMissThreshold(byte misses) { _missThreshold = misses ? misses : 1; }
+ 
+   State GetState() const { return _state; }
+   MFRC522::StatusCode GetLastStatus() const { return _lastStatus; }
+   uint16_t GetAtqa() const { return ((uint16_t)_atqa[1] << 8) | _atqa[0]; }
+ 
+   // Step() latency statistics, in microseconds
+   uint32_t GetLastStepMicros() const { return _lastStepMicros; }
+   uint32_t GetMaxStepMicros() const { return _maxStepMicros; }
+   State GetMaxStepState() const { return _maxStepState; }
+   uint32_t GetStepCount() const { return _stepCount; }
+   void ResetStats();
+ 
+ protected:
+   MFRC522 &_mfrc522;
+   State _state;
+   uint16_t _pollInterval;		// ms between REQA polls while no PICC is present
+   uint16_t _presenceInterval;	// ms between presence checks while a PICC is selected
+   byte _missThreshold;			// Consecutive unanswered WUPAs before EVENT_CARD_LEFT
+   byte _misses;
+   uint32_t _lastPoll;			// millis() of the last REQA/presence check
+ 
+   // Buffers of the exchange in flight, they must outlive the Step() that started it
+   byte _command[4];
+   byte _atqa[2];
+   byte _atqaSize;
+   byte _validBits;
+   volatile bool _asyncDone;
+   MFRC522::StatusCode _asyncStatus;
+   MFRC522::StatusCode _lastStatus;
+ 
+   uint32_t _lastStepMicros;
+   uint32_t _maxStepMicros;
+   State _maxStepState;
+   uint32_t _stepCount;
+ 
+   Event StepState();
+   MFRC522::StatusCode StartRequest(byte command);
+   MFRC522::StatusCode StartHalt();
+   bool AtqaValid(MFRC522::StatusCode status) const;
+   static void OnAsyncDone(MFRC522::StatusCode status, void *context);
+ };
+ #endif // MFRC522_NO_ASYNC
+ 
+ #endif
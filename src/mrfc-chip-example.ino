@@ -223,6 +223,12 @@ void test_PICC_ReadCardSerial() {
 
 // Выбор карты по UID
 void test_PICC_Select() {
+  // Выбранная (ACTIVE) карта не отвечает ни на ANTICOLLISION, ни на WUPA (ISO/IEC 14443-3):
+  // переводим её в HALT и будим WUPA
+  byte bufferATQA[2];
+  byte bufferSize = sizeof(bufferATQA);
+  mfrc522.PICC_HaltA();
+  mfrc522.PICC_WakeupA(bufferATQA, &bufferSize);
   byte result = mfrc522.PICC_Select(&(mfrc522.uid));
   printTestResult("PICC_Select", result == 0); // теперь OK если STATUS_OK
 }
@@ -383,6 +389,8 @@ void test_all() {
   test_PCD_PerformSelfTest();
   test_PCD_SoftPowerDown();
   test_PCD_SoftPowerUp();
+  // После SoftPowerUp поле включено заново: карте нужно до 5 мс, чтобы запитаться (ISO/IEC 14443-3)
+  delay(5);
 
   // Тесты PICC и MIFARE функций
   // Ожидание карты
@@ -403,6 +411,11 @@ void test_all() {
 
   test_MIFARE_UnbrickUidSector();
   test_MIFARE_SetUid();
+  // После записи через бэкдор карта в HALT: будим и выбираем её с новым UID
+  byte bufferATQA[2];
+  byte bufferSize = sizeof(bufferATQA);
+  mfrc522.PICC_WakeupA(bufferATQA, &bufferSize);
+  mfrc522.PICC_ReadCardSerial();
   test_PCD_Authenticate();
   test_MIFARE_Read();
   test_MIFARE_Write();
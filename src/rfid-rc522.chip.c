@@ -3,6 +3,11 @@
 // For more information and source code, see: https://github.com/anton21m
 // Author: Anton21m blackdark20@mail.ru
 
+#ifdef DISPATCH_BENCH_FRAMES
+#define timer_t libc_timer_t // wokwi-api.h defines its own timer_t
+#include <time.h>
+#undef timer_t
+#endif
 #include "wokwi-api.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -13,6 +18,29 @@
 #define NUM_REGISTERS 64
 #define FIFO_SIZE 64
 
+// Oscillator start-up after NRSTPD goes high (datasheet 8.8.2): crystal start-up + 37.74 us
+#define OSC_STARTUP_US 5000
+
+// ISO/IEC 14443A at 106 kbit/s: one bit lasts 128/fc = 9.44 us, a byte is sent with its parity bit
+#define AIR_BYTE_NS (9 * 128 * 1000000000ULL / 13560000)
+// Frame delay time from the end of a PCD frame to the PICC answer, 1236/fc (ISO/IEC 14443-3 6.2.1.1, n = 9)
+#define PICC_FDT_NS (1236 * 1000000000ULL / 13560000)
+// CRC coprocessor: one FIFO byte per 8 clocks of 13.56 MHz (estimate, the datasheet gives no figure)
+#define CRC_BYTE_NS (8 * 1000000000ULL / 13560000)
+
+// PCD command scheduler queue length, see pcd_event_t
+#define PCD_QUEUE_SIZE 8
+
+// Frame dispatch benchmark, off by default. Built with -DDISPATCH_BENCH_FRAMES=N every frame is classified N times
+// through the personality table and N times through a switch over the card type, the static dispatch of the former
+// process_mifare_command(); the frame summary then shows the host time per classification of both.
+// The host time comes from C11 timespec_get().
+
+// Energy and bus accounting register window in the reserved registers (not part of a real MFRC522):
+// write ENERGY_SEL_REG to select an energy_item_t and latch it, then read its 4 bytes LSB first from ENERGY_DATA_REG
+#define ENERGY_SEL_REG  0x3C
+#define ENERGY_DATA_REG 0x3D
+
 // MIFARE commands
 #define CMD_REQA 0x26
 #define CMD_WUPA 0x52
@@ -39,28 +67,370 @@
 #define CMD_RESTORE       0xC2 // MIFARE Restore
 #define CMD_TRANSFER      0xB0 // MIFARE Transfer
 #define CMD_UL_WRITE      0xA2 // MIFARE Ultralight Write
+#define CMD_HLTA          0x50
+#define CMD_GET_VERSION   0x60 // NTAG GET_VERSION, same code as AUTH_A
+#define CMD_RATS          0xE0 // ISO/IEC 14443-4 Request for Answer To Select
+#define CMD_PPS           0xD0 // ISO/IEC 14443-4 Protocol and Parameter Selection, low nibble = CID
+
+// Shared read-only card templates. All chip instances read from them; an instance gets its
+// own copy of the card memory only when the card is written (copy-on-write, see card_block_mut).
+// Block 0 holds the UID and BCC of a MIFARE Classic card, uid7 the UID of the card types with a
+// 7 byte UID. The other blocks of a fresh card depend only on the card type.
+typedef struct {
+  uint8_t block0[16];
+  uint8_t uid7[7];
+} card_template_t;
+
+static const card_template_t CARD_TEMPLATES[6] = {
+  {{0}, {0}},                                                                      // 0: no card
+  {{0x50, 0x9D, 0x39, 0x23, 0xD7}, {0x04, 0x50, 0x9D, 0x39, 0x23, 0x6A, 0x80}},   // Uid1
+  {{0x77, 0x18, 0x40, 0x05, 0x2A}, {0x04, 0x77, 0x18, 0x40, 0x05, 0x2B, 0x80}},   // Uid2
+  {{0x9F, 0xD6, 0xB1, 0xBD, 0x45}, {0x04, 0x9F, 0xD6, 0xB1, 0xBD, 0x4C, 0x80}},   // Uid3
+  {{0x0A, 0x1B, 0x2C, 0x3D, 0x00}, {0x04, 0x0A, 0x1B, 0x2C, 0x3D, 0x5E, 0x80}},   // Uid4
+  {{0xF1, 0xE2, 0xD3, 0xC4, 0x04}, {0x04, 0xF1, 0xE2, 0xD3, 0xC4, 0xB5, 0x80}}    // Uid5
+};
+#define NUM_CARD_TEMPLATES (sizeof(CARD_TEMPLATES) / sizeof(CARD_TEMPLATES[0]))
+
+// Card type of each slot, attributes card1Type..card5Type (default MIFARE Classic 1K), see CARD_PERSONALITIES
+typedef enum {
+  CARD_CLASSIC_1K,
+  CARD_CLASSIC_4K,
+  CARD_ULTRALIGHT,
+  CARD_NTAG213,
+  CARD_ISO_DEP,
+  CARD_TYPES
+} card_type_t;
+
+static const char *const CARD_TYPE_ATTR_NAMES[NUM_CARD_TEMPLATES - 1] = {
+  "card1Type", "card2Type", "card3Type", "card4Type", "card5Type"
+};
+
+// UID changeable ("magic") variant of the MIFARE Classic card in each slot, attributes card1Magic..card5Magic.
+// The default is Gen1a, the card the library's backdoor functions are written for.
+typedef enum {
+  MAGIC_NONE,   // Genuine card: block 0 is read-only, no backdoor
+  MAGIC_GEN1A,  // HLTA, 0x40 (7 bits), 0x43 unlock it: READ/WRITE of every block without authentication until HLTA
+  MAGIC_GEN2,   // CUID: block 0 is written like any other block after authentication, no backdoor
+  MAGIC_LOCKED, // Gen1a whose UID has been locked: 0x40 is still answered, 0x43 gets a NAK, block 0 is read-only
+  MAGIC_TYPES
+} card_magic_t;
+
+static const char *const CARD_MAGIC_ATTR_NAMES[NUM_CARD_TEMPLATES - 1] = {
+  "card1Magic", "card2Magic", "card3Magic", "card4Magic", "card5Magic"
+};
+static const char *const CARD_MAGIC_NAMES[MAGIC_TYPES] = {"none", "gen1a", "gen2", "locked"};
+
+static const uint8_t BLANK_BLOCK[16] = {0};
+static const uint8_t DEFAULT_TRAILER[16] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // Key A
+  0xFF, 0x07, 0x80,                   // Access Bits (default configuration)
+  0x69,                               // User Data Byte (GPB)
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // Key B
+};
+
+// NTAG213 pages 0x28-0x2C: dynamic lock bytes, CFG0 (AUTH0 = 0xFF, no password protection), CFG1, PWD, PACK
+static const uint8_t NTAG213_CONFIG_BLOCKS[2][16] = {
+  { 0x00, 0x00, 0x00, 0xBD, 0x04, 0x00, 0x00, 0xFF, 0x00, 0x05, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF },
+  { 0x00, 0x00, 0x00, 0x00 }
+};
+static const uint8_t NTAG213_VERSION[8] = { 0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x0F, 0x03 };
+
+// Answer to RATS: TL, T0 (TA1, TB1, TC1 follow, FSCI = 5), TA1 = 106 kbit/s only, TB1, TC1, one historical byte
+static const uint8_t ISO_DEP_ATS[6] = { 0x06, 0x75, 0x00, 0x81, 0x02, 0x80 };
+
+// Register values after a hard reset (datasheet 9.3, column "reset value"), 0x00 where none is given
+static const uint8_t REGISTER_RESET_VALUES[NUM_REGISTERS] = {
+  [0x01] = 0x20, // CommandReg (RcvOff)
+  [0x02] = 0x80, // ComIEnReg (IRqInv)
+  [0x04] = 0x14, // ComIrqReg
+  [0x07] = 0x21, // Status1Reg
+  [0x0B] = 0x08, // WaterLevelReg
+  [0x0C] = 0x10, // ControlReg
+  [0x0E] = 0xA0, // CollReg
+  [0x11] = 0x3F, // ModeReg
+  [0x14] = 0x80, // TxControlReg
+  [0x16] = 0x10, // TxSelReg
+  [0x17] = 0x84, // RxSelReg
+  [0x18] = 0x84, // RxThresholdReg
+  [0x19] = 0x4D, // DemodReg
+  [0x1C] = 0x62, // MfTxReg
+  [0x1F] = 0xEB, // SerialSpeedReg
+  [0x21] = 0xFF, // CRCResultRegH
+  [0x22] = 0xFF, // CRCResultRegL
+  [0x24] = 0x26, // ModWidthReg
+  [0x26] = 0x48, // RFCfgReg
+  [0x27] = 0x88, // GsNReg
+  [0x28] = 0x20, // CWGsPReg
+  [0x29] = 0x20, // ModGsPReg
+  [0x33] = 0x80, // TestPinEnReg
+  [0x36] = 0x40, // AutoTestReg
+  [VERSION_REG] = REG_VERSION,
+};
+
+// Scripted card taps, selected with the tapScenario attribute (0 = the selectedCard slider decides).
+// A scenario is a list of card states played in a loop from tapStartMs on.
+typedef struct {
+  uint8_t card;          // 0 = no card, 1-5 = CARD_TEMPLATES index
+  uint16_t duration_ms;  // Time until the next step
+} tap_step_t;
 
-// Pre-defined UIDs for 5 different cards
-static const uint8_t CARD_UIDS[5][4] = {
-    {0x50, 0x9D, 0x39, 0x23}, // UId1
-    {0x77, 0x18, 0x40, 0x05}, // Uid2
-    {0x9F, 0xD6, 0xB1, 0xBD}, // Uid3
-    {0x0A, 0x1B, 0x2C, 0x3D}, // Uid4
-    {0xF1, 0xE2, 0xD3, 0xC4}  // Uid5
+typedef struct {
+  const char *name;
+  const tap_step_t *steps;
+  uint8_t step_count;
+} tap_scenario_t;
+
+static const tap_step_t TAPS_SLOW[] = { {1, 300}, {0, 700} };                  // 60 taps/min
+static const tap_step_t TAPS_FAST[] = { {1, 100}, {0, 100} };                  // 300 taps/min
+static const tap_step_t TAPS_SHORT_DWELL[] = { {1, 30}, {0, 170} };            // 300 taps/min, card barely in the field
+static const tap_step_t TAPS_SWAP[] = { {1, 400}, {2, 400}, {0, 200} };        // Card swapped without leaving the field
+static const tap_step_t TAPS_ALL_CARDS[] = {
+  {1, 150}, {0, 100}, {2, 150}, {0, 100}, {3, 150}, {0, 100}, {4, 150}, {0, 100}, {5, 150}, {0, 100}
 };
+#define TAP_STEPS(steps) steps, (uint8_t)(sizeof(steps) / sizeof(steps[0]))
+
+static const tap_scenario_t TAP_SCENARIOS[] = {
+  {"manual", NULL, 0},
+  {"slow taps", TAP_STEPS(TAPS_SLOW)},
+  {"fast taps", TAP_STEPS(TAPS_FAST)},
+  {"short dwell", TAP_STEPS(TAPS_SHORT_DWELL)},
+  {"swap", TAP_STEPS(TAPS_SWAP)},
+  {"all cards", TAP_STEPS(TAPS_ALL_CARDS)},
+};
+#define NUM_TAP_SCENARIOS (sizeof(TAP_SCENARIOS) / sizeof(TAP_SCENARIOS[0]))
+#define TAP_SUMMARY_EVERY 50
+
+// Fault injection on PICC exchanges (PCD_Transceive the PICC answered). faultTypes is a mask of these,
+// the enabled types are used in turn.
+#define FAULT_CRC         0x01 // Last response byte corrupted, CRCErr
+#define FAULT_PARITY      0x02 // ParityErr
+#define FAULT_PROTOCOL    0x04 // ProtocolErr
+#define FAULT_COLLISION   0x08 // CollErr, CollReg.CollPosNotValid
+#define FAULT_BUFFER_OVFL 0x10 // BufferOvfl
+#define FAULT_NO_RESPONSE 0x20 // Answer lost, TimerIRq
+#define FAULT_NAK         0x40 // Answer replaced by a 4 bit NAK
+#define NUM_FAULT_TYPES   7
+
+static const char *const FAULT_NAMES[NUM_FAULT_TYPES] = {
+  "CRC", "parity", "protocol", "collision", "buffer overflow", "no response", "NAK"
+};
+
+// Card distance model (cardDistance attribute, mm). The PICC load modulation falls with the cube of the
+// distance (60 dB/decade); REQUIRED_GAIN_DB is the RxGain needed for a clean answer, in 5 mm steps, set for
+// 50 mm range at the maximum 48 dB. The field powers the PICC up to CARD_POWER_RANGE_MM whatever the gain.
+static const int8_t REQUIRED_GAIN_DB[] = { -60, -12, 6, 17, 24, 30, 35, 39, 42, 45, 48, 51, 53 };
+#define CARD_POWER_RANGE_MM 60
+// RFCfgReg.RxGain codes 0-7 (datasheet 9.3.3.6)
+static const uint8_t RX_GAIN_DB[8] = { 18, 23, 18, 23, 33, 38, 43, 48 };
+
+// Only used to number instances in the log
+static uint8_t g_instance_count;
 
 typedef enum {
   SPI_STATE_IDLE,
   SPI_STATE_WAIT_DATA,
 } spi_transaction_state_t;
 
+// Power states (datasheet 8.6)
+typedef enum {
+  POWER_ACTIVE,       // Oscillator running, antenna drivers and receiver on
+  POWER_ANALOG_OFF,   // Oscillator running, antenna drivers (TxControlReg) or receiver (CommandReg.RcvOff) off
+  POWER_SOFT_DOWN,    // CommandReg.PowerDown: oscillator off, registers and SPI kept, RF field ignored
+  POWER_HARD_DOWN,    // NRSTPD low or oscillator start-up after it: SPI ignored
+} power_state_t;
+
+static const char *const POWER_STATE_NAMES[] = {"active", "analog off", "soft power-down", "hard power-down"};
+
+// PICC states (ISO/IEC 14443-3 figure 7, MIFARE Classic adds AUTHENTICATED). REQA only wakes IDLE, WUPA also HALT.
+// A frame a state does not expect makes READY/ACTIVE/AUTHENTICATED fall back silently: to HALT if the PICC was
+// woken from HALT (the READY*/ACTIVE* states, picc_halted), to IDLE otherwise.
+typedef enum {
+  PICC_POWER_OFF,     // No card, field off or card not powered up yet
+  PICC_IDLE,          // Powered by the field, waits for REQA/WUPA
+  PICC_READY,         // Answered REQA/WUPA, in anticollision
+  PICC_ACTIVE,        // Selected
+  PICC_HALT,          // HLTA received, only WUPA wakes it
+  PICC_AUTHENTICATED, // Crypto1 session open
+  PICC_STATES
+} picc_state_t;
+
+static const char *const PICC_STATE_NAMES[PICC_STATES] = {"power off", "idle", "ready", "active", "halt", "authenticated"};
+
+// Frames a PICC can receive, the columns of PICC_TRANSITIONS
+typedef enum {
+  FRAME_REQA,
+  FRAME_WUPA,
+  FRAME_SELECT,       // ANTICOLLISION or SELECT, any cascade level
+  FRAME_HLTA,
+  FRAME_AUTH,
+  FRAME_MEMORY,       // Command set of the card: READ, WRITE, value operations and their second part, ISO-DEP blocks
+  FRAME_ULTRALIGHT,   // Ultralight WRITE sent to a MIFARE Classic card, no authentication
+  FRAME_BACKDOOR,     // Chinese magic card unlock, 0x40 (7 bits) then 0x43
+  FRAME_UNKNOWN,
+  FRAME_TYPES
+} frame_type_t;
+
+// What a PICC does with a frame: process it (the handler picks the next state), ignore it, or fall back to IDLE/HALT
+#define PICC_HANDLE    0
+#define PICC_IGNORE    1
+#define PICC_FALL_BACK 2
+#define H PICC_HANDLE
+#define I PICC_IGNORE
+#define F PICC_FALL_BACK
+static const uint8_t PICC_TRANSITIONS[PICC_STATES][FRAME_TYPES] = {
+  //                    REQA WUPA SEL HLTA AUTH MEM  UL  BACKDOOR UNKNOWN
+  [PICC_POWER_OFF]     = { I,   I,   I,   I,   I,   I,   I,   I,   I },
+  [PICC_IDLE]          = { H,   H,   I,   I,   I,   I,   I,   H,   I },
+  [PICC_READY]         = { F,   F,   H,   F,   F,   F,   F,   F,   F },
+  [PICC_ACTIVE]        = { F,   F,   F,   H,   H,   H,   H,   F,   F },
+  [PICC_HALT]          = { I,   H,   I,   I,   I,   I,   I,   H,   I },
+  [PICC_AUTHENTICATED] = { F,   F,   F,   H,   H,   H,   H,   F,   F },
+};
+#undef H
+#undef I
+#undef F
+
+// Card personality: the command set of a card type on top of the ISO/IEC 14443-3 layer. process_mifare_command()
+// handles REQA/WUPA, anticollision, SELECT and HLTA itself with the ATQA, UID and SAK given here and hands every
+// other frame the personality classifies to its handle_frame(). The memory image is blocks * 16 bytes; a fresh card
+// is built from its template by load() (UID, block 0) and fresh_block() (blocks > 0).
+struct chip_state;
+typedef struct {
+  const char *name;
+  uint16_t atqa;              // Sent LSB first
+  uint8_t sak;                // SAK of the last cascade level
+  uint8_t uid_size;           // 4 or 7 bytes
+  uint16_t blocks;            // Memory image in 16 byte blocks, 0 = none
+  uint8_t pages;              // Ultralight/NTAG: 4 byte pages, 0 = no page access
+  bool crypto1;               // MFAuthent works
+  const uint8_t *ats;         // Answer to RATS, TL first; NULL without ISO/IEC 14443-4
+  frame_type_t (*classify)(struct chip_state *chip);  // FRAME_UNKNOWN: not part of the card's command set
+  void (*handle_frame)(struct chip_state *chip);      // Accepted frame of the command set, in the FIFO
+  void (*activate)(struct chip_state *chip);          // SELECT completed
+  void (*halt)(struct chip_state *chip);              // The card leaves ACTIVE/AUTHENTICATED
+  void (*load)(struct chip_state *chip, const card_template_t *card);
+  const uint8_t *(*fresh_block)(struct chip_state *chip, uint8_t block);
+} card_personality_t;
+
+// PCD command scheduler. The SPI callback only queues CommandReg and StartSend writes; pcd_timer executes them in
+// order. A command changes the FIFO and the data registers when it is executed, but the interrupt request bits it
+// raises are queued as a PCD_EVENT_RESULT and become visible when the command would have finished on silicon.
+typedef enum {
+  PCD_EVENT_COMMAND,    // CommandReg written, value = command
+  PCD_EVENT_START_SEND, // BitFramingReg.StartSend written
+  PCD_EVENT_RESULT,     // The running command finishes: com_irq/div_irq are set in ComIrqReg/DivIrqReg
+} pcd_event_type_t;
+
 typedef struct {
+  uint64_t due_ns;
+  uint8_t type;
+  uint8_t value;
+  uint8_t com_irq;
+  uint8_t div_irq;
+} pcd_event_t;
+
+// Items of the energy register window. The first four are the power_state_t times.
+typedef enum {
+  ENERGY_ANTENNA_MS,    // Antenna on, not transceiving
+  ENERGY_IDLE_MS,       // Analog off
+  ENERGY_SOFT_DOWN_MS,
+  ENERGY_HARD_DOWN_MS,
+  ENERGY_TRANSCEIVE_MS, // Estimated air time of PICC exchanges
+  ENERGY_CHARGE_UAH,    // Charge since chip_init, weighted by the current attributes
+  ENERGY_AVERAGE_UA,
+  ENERGY_SPI_TRANSACTIONS, // Bus utilization since chip_init: CS low periods,
+  ENERGY_SPI_BYTES,        // bytes clocked while selected
+  ENERGY_SPI_CS_LOW_US,    // and the time CS was held low
+  ENERGY_ITEMS
+} energy_item_t;
+
+// Supply current attributes (uA) and their defaults: typical IDVDD + IAVDD + ITVDD (datasheet table 148),
+// ITVDD max while transceiving, max Ihpd/Ispd in power-down
+static const char *const CURRENT_ATTR_NAMES[] = {
+  "currentAntennaUa", "currentIdleUa", "currentSoftPdUa", "currentHardPdUa", "currentTransceiveUa"
+};
+static const uint32_t CURRENT_DEFAULTS_UA[] = { 73500, 13500, 10, 5, 113500 };
+
+typedef struct chip_state {
+  uint8_t instance_id;
   pin_t cs_pin;
+  pin_t irq_pin;
+  pin_t rst_pin;
   uint32_t spi;
 
+  // Power state. in_reset: NRSTPD low or the oscillator is still starting after the rising edge.
+  // soft_power_down: entered with PCD_SoftPowerDown(), kept until the wake-up has finished.
+  // osc_starting: wake-up in progress (hard reset or leaving soft power-down), osc_timer ends it.
+  power_state_t power_state;
+  bool in_reset;
+  bool soft_power_down;
+  bool osc_starting;
+  uint32_t osc_timer;
+  uint32_t skip_osc_startup_attr_id;
+
+  // PCD command scheduler: events ordered by due_ns, pcd_timer fires for the first one
+  pcd_event_t pcd_queue[PCD_QUEUE_SIZE];
+  uint8_t pcd_queue_len;
+  uint32_t pcd_timer;
+
+  // RF field (TX1/TX2 driving, oscillator running) and the PICC powered by it
+  bool field_on;
+  uint64_t field_on_ns;               // Simulation time the field was switched on
+  uint32_t card_power_up_attr_id;     // us the PICC needs after field on before it answers
+  uint32_t card_distance_attr_id;     // mm between the PICC and the antenna
+  uint64_t card_arrival_ns;           // Simulation time the current card entered the field
+
+  // Card taps: scenario playback and tap statistics (slider changes count as taps too)
+  uint8_t tap_scenario;               // TAP_SCENARIOS index, 0 = manual
+  uint8_t tap_step;
+  uint32_t tap_timer;
+  bool tap_open;                      // A card is in the field
+  bool tap_seen;                      // The firmware has selected it during this tap
+  uint32_t taps;
+  uint32_t taps_missed;
+  uint64_t tap_latency_sum_ns;        // Card arrival to SELECT, over the taps seen
+  uint64_t tap_latency_max_ns;
+  uint64_t tap_latency_min_ns;
+
+  // Fault injection: every faultEvery-th matching exchange, or with faultPerMille probability if faultEvery is 0
+  uint32_t fault_types_attr_id;
+  uint32_t fault_per_mille_attr_id;
+  uint32_t fault_every_attr_id;
+  uint32_t fault_command_attr_id;     // PICC command byte the faults apply to, 0 = all
+  uint32_t fault_rng;                 // next_random() state, seeded with faultSeed
+  uint32_t fault_exchanges;           // Exchanges the injector has looked at
+  uint32_t faults_injected;
+  uint8_t fault_next_type;
+
+  // Energy accounting: time per power state and estimated transceive air time (part of the active time)
+  uint64_t state_since_ns;
+  uint64_t state_ns[4];
+  uint64_t transceive_ns;
+  uint32_t current_attr_ids[5];       // uA, indexed like the first five energy_item_t
+  uint32_t energy_report_attr_id;     // ms between summaries, 0 = off
+  uint32_t energy_timer;
+  uint64_t energy_report_due_ns;
+  uint8_t energy_latch[4];
+  uint8_t energy_byte;
+
+  // Bus utilization: SPI traffic addressed to this chip, printed with the energy summary as the change since the last one
+  uint32_t spi_transactions;
+  uint32_t spi_bytes;
+  uint64_t spi_cs_low_ns;
+  uint64_t spi_cs_low_since_ns;
+  uint32_t bus_report_transactions;
+  uint32_t bus_report_bytes;
+  uint64_t bus_report_cs_low_ns;
+  uint64_t bus_report_ns;
+
   uint8_t registers[NUM_REGISTERS];
   uint8_t fifo[FIFO_SIZE];
   uint8_t fifo_len;
+  uint8_t frame_command;  // First byte written to the empty FIFO: PICC command of the next exchange
+  // Transceive stays active after an exchange (datasheet 10.3.1.8): each StartSend sends the FIFO again.
+  // transceive_sent: the exchange already ran when the command was written, the StartSend after it belongs to it.
+  bool transceive_active;
+  bool transceive_sent;
 
   uint8_t spi_buffer[18];
   spi_transaction_state_t spi_transaction_state;
@@ -68,48 +438,65 @@ typedef struct {
   bool is_read;
   uint8_t read_count;
 
-  // Emulated card data (MIFARE Classic 1K = 16 sectors * 4 blocks * 16 bytes)
-  uint8_t card_data[16 * 4 * 16];
-  uint8_t uid[4];
+  // Emulated card: personality of the card type in the slot, UID and memory image. card_data is NULL until the
+  // first write, then a private copy of card_data_size bytes; card_dirty tells whether it or the shared template
+  // (fresh_block0 and fresh_block()) holds the current card content.
+  const card_personality_t *personality;
+  uint8_t *card_data;
+  uint16_t card_data_size;
+  bool card_dirty;
+  uint8_t uid[7];
+  uint8_t uid_size;
+  uint8_t fresh_block0[16];
 
   // NEW: Selected card index and Wokwi attribute ID
   uint32_t selected_card_attr_id;
-  uint8_t selected_card_index; // 0 = no card, 1-5 = CARD_UIDS index + 1
+  uint8_t selected_card_index; // 0 = no card, 1-5 = CARD_TEMPLATES index
+  uint32_t card_type_attr_ids[NUM_CARD_TEMPLATES - 1]; // card_type_t of each slot
+  uint32_t card_magic_attr_ids[NUM_CARD_TEMPLATES - 1]; // card_magic_t of each slot
+  uint8_t card_magic;                                   // card_magic_t of the card in the field
+
+  // Frame dispatch since the last summary: frames of the ISO 14443-3 layer, frames handed to the personality and
+  // calls through the personality table (classify for every frame, handle_frame for the card's own frames)
+  uint32_t frames_iso;
+  uint32_t frames_card;
+  uint32_t personality_calls;
+#ifdef DISPATCH_BENCH_FRAMES
+  uint64_t bench_table_ns;  // Host time of the benchmark classifications through the table
+  uint64_t bench_switch_ns; // and through the switch
+  uint32_t bench_frames;    // Classifications in each of the two
+#endif
 
   // New internal data register for MIFARE Value Block operations (Restore/Transfer)
   uint8_t internal_data_register[16];
 
-  // State variables
-  bool card_selected;
-  bool authenticated;
-
-  // Флаг: карта уже была обнаружена (для IsNewCardPresent)
-  bool card_was_present;
+  // State of the PICC in the field (PICC_POWER_OFF when there is none), changed with set_picc_state() only.
+  // picc_halted: woken from HALT, falls back to HALT. select_level: READY, cascade levels already selected.
+  picc_state_t picc_state;
+  bool picc_halted;
+  uint8_t select_level;
 
-  // Internal variables for anticollision, auth, etc.
-  uint8_t anticoll_step;
-  bool uid_read_completed;
-  uint8_t cascade_level;
-  uint8_t current_level_known_bits;
-  
-  // New variables for proper SELECT handling
-  bool select_completed;
-  uint8_t select_response_sent;
+  // ISO-DEP: RATS answered, the card exchanges ISO/IEC 14443-4 blocks until DESELECT
+  bool iso_dep_active;
 
   // Streaming write state: true while CS is low and we are writing consecutive bytes into FIFO
   bool stream_write_to_fifo;
 
-  // Backdoor variables
-  bool uid_backdoor_step1;
+  // Gen1a backdoor: uid_backdoor_open, 0x40 answered in IDLE/HALT and 0x43 expected next;
+  // magic_unlocked, 0x43 answered, READ/WRITE without authentication until the card leaves ACTIVE
   bool uid_backdoor_open;
+  bool magic_unlocked;
 
   // MIFARE write command state
-  int8_t pending_write_block; // -1 if no pending write, otherwise block address
+  int16_t pending_write_block; // -1 if no pending write, otherwise block address (0-255)
   uint8_t pending_write_len;  // Expected length of data for pending write
 
   // NEW: MIFARE two-step command state
   int8_t pending_mifare_twostep_command; // -1 if no pending, otherwise the command (CMD_DECREMENT, CMD_INCREMENT, etc.)
   uint8_t pending_mifare_twostep_block_addr; // The block address for the pending two-step command
+
+  // Current level driven on the IRQ pin (active low while ComIEnReg.IRqInv is set)
+  uint32_t irq_level;
 } chip_state_t;
 
 // Forward declarations
@@ -120,6 +507,7 @@ static void chip_spi_done(void *user_data, uint8_t *buffer, uint32_t count);
 static void handle_reqa_wupa_command(chip_state_t *chip);
 static void handle_anticoll_command(chip_state_t *chip);
 static void handle_select_command(chip_state_t *chip);
+static void handle_auth_command(chip_state_t *chip);
 
 // SPI read/write functions
 static void handle_spi_read_command(chip_state_t *chip);
@@ -141,8 +529,89 @@ static void reset_chip_state(chip_state_t *chip);
 static void set_irq_flag(chip_state_t *chip);
 static void clear_irq_flag(chip_state_t *chip, uint8_t flag);
 static void set_specific_irq_flag(chip_state_t *chip, uint8_t flag);
+static void update_irq_pin(chip_state_t *chip);
 static void log_chip_state(chip_state_t *chip);
+static void load_card(chip_state_t *chip);
+static const uint8_t *card_block(chip_state_t *chip, uint8_t block);
+static uint8_t *card_block_mut(chip_state_t *chip, uint8_t block);
+static bool card_write(chip_state_t *chip, uint8_t block, const uint8_t *data, uint8_t len);
+static void report_memory(chip_state_t *chip);
+static void hard_reset(chip_state_t *chip);
+static void chip_osc_ready(void *user_data);
+static void start_oscillator(chip_state_t *chip);
+static void update_power_state(chip_state_t *chip);
+static void poll_selected_card(chip_state_t *chip);
+static void card_power_off(chip_state_t *chip);
+static void set_picc_state(chip_state_t *chip, picc_state_t state);
+static void picc_fall_back(chip_state_t *chip);
+static frame_type_t classify_frame(chip_state_t *chip);
+static bool picc_accepts(chip_state_t *chip, frame_type_t frame);
+static bool card_answers(chip_state_t *chip);
+static void change_card(chip_state_t *chip, uint8_t card);
+static void chip_tap_step(void *user_data);
+static void tap_selected(chip_state_t *chip);
+static void report_taps(chip_state_t *chip);
+static void inject_fault(chip_state_t *chip, uint8_t command);
+static uint32_t next_random(chip_state_t *chip);
+static void apply_fault(chip_state_t *chip, uint8_t fault);
+static int link_margin_db(chip_state_t *chip);
+static void apply_link_quality(chip_state_t *chip);
+static void account_power(chip_state_t *chip);
+static void account_transceive(chip_state_t *chip, uint8_t tx_bytes, uint8_t rx_bytes);
+static uint32_t energy_item(chip_state_t *chip, uint8_t item);
+static void update_energy_timer(chip_state_t *chip);
+static void chip_energy_report(void *user_data);
+static void report_bus(chip_state_t *chip);
+static void run_transceive(chip_state_t *chip);
+static void execute_command(chip_state_t *chip, uint8_t val);
+static void pcd_queue_push(chip_state_t *chip, uint8_t type, uint8_t value, uint64_t delay_ns, uint8_t com_irq,
+                           uint8_t div_irq);
+static void pcd_queue_cancel(chip_state_t *chip, bool results_only);
+static void pcd_schedule(chip_state_t *chip);
+static void pcd_finish_after(chip_state_t *chip, uint8_t com_before, uint8_t div_before, uint64_t duration_ns);
+static uint64_t pcd_timer_ns(chip_state_t *chip);
+static void chip_pcd_step(void *user_data);
 void send_ack_response(chip_state_t *chip);
+static void send_nak_response(chip_state_t *chip);
+static void send_response_with_crc(chip_state_t *chip, uint8_t len);
+static bool cascade_uid(chip_state_t *chip, uint8_t level, uint8_t *bytes);
+static void report_frames(chip_state_t *chip);
+
+// Card personalities
+static void personality_no_op(chip_state_t *chip);
+static frame_type_t classic_classify(chip_state_t *chip);
+static void classic_handle_frame(chip_state_t *chip);
+static void classic_halt(chip_state_t *chip);
+static void classic_load(chip_state_t *chip, const card_template_t *card);
+static const uint8_t *classic_fresh_block(chip_state_t *chip, uint8_t block);
+static uint8_t classic_trailer(uint8_t block);
+static void gen1a_handle_frame(chip_state_t *chip);
+static frame_type_t ultralight_classify(chip_state_t *chip);
+static frame_type_t ntag_classify(chip_state_t *chip);
+static void ultralight_handle_frame(chip_state_t *chip);
+static void ultralight_load(chip_state_t *chip, const card_template_t *card);
+static void ntag_load(chip_state_t *chip, const card_template_t *card);
+static const uint8_t *ultralight_fresh_block(chip_state_t *chip, uint8_t block);
+static const uint8_t *ntag_fresh_block(chip_state_t *chip, uint8_t block);
+static frame_type_t iso_dep_classify(chip_state_t *chip);
+static void iso_dep_handle_frame(chip_state_t *chip);
+static void iso_dep_reset(chip_state_t *chip);
+static void iso_dep_load(chip_state_t *chip, const card_template_t *card);
+
+// Indexed by card_type_t. ATQA/SAK as sent by NXP parts (AN10833); the ISO-DEP card looks like a DESFire.
+static const card_personality_t CARD_PERSONALITIES[CARD_TYPES] = {
+  [CARD_CLASSIC_1K] = { "classic-1k", 0x0004, 0x08, 4, 64, 0, true, NULL, classic_classify, classic_handle_frame,
+                        personality_no_op, classic_halt, classic_load, classic_fresh_block },
+  [CARD_CLASSIC_4K] = { "classic-4k", 0x0002, 0x18, 4, 256, 0, true, NULL, classic_classify, classic_handle_frame,
+                        personality_no_op, classic_halt, classic_load, classic_fresh_block },
+  [CARD_ULTRALIGHT] = { "ultralight", 0x0044, 0x00, 7, 4, 16, false, NULL, ultralight_classify,
+                        ultralight_handle_frame, personality_no_op, personality_no_op, ultralight_load,
+                        ultralight_fresh_block },
+  [CARD_NTAG213]    = { "ntag213", 0x0044, 0x00, 7, 12, 45, false, NULL, ntag_classify, ultralight_handle_frame,
+                        personality_no_op, personality_no_op, ntag_load, ntag_fresh_block },
+  [CARD_ISO_DEP]    = { "iso-dep", 0x0344, 0x20, 7, 0, 0, false, ISO_DEP_ATS, iso_dep_classify,
+                        iso_dep_handle_frame, iso_dep_reset, iso_dep_reset, iso_dep_load, NULL },
+};
 
 // CRC_A для ISO14443A (полином 0x8408, начальное значение 0x6363)
 static void calc_crc_a(const uint8_t *data, size_t len, uint8_t *crc) {
@@ -207,53 +676,26 @@ static void encode_mifare_value(uint8_t *buffer, int32_t value, uint8_t block_ad
 
 void chip_init(void) {
   chip_state_t *chip = calloc(1, sizeof(chip_state_t));
+  chip->instance_id = g_instance_count++;
   chip->cs_pin = pin_init("CS", INPUT_PULLUP);
 
   // Initialize Wokwi control for card selection
   chip->selected_card_attr_id = attr_init("selectedCard", 0); // Default to 0 (no card)
   chip->selected_card_index = attr_read(chip->selected_card_attr_id);
-
-  // Initialize UID (will be updated when card is selected)
-  if (chip->selected_card_index > 0 && chip->selected_card_index <= 5) {
-      memcpy(chip->uid, CARD_UIDS[chip->selected_card_index - 1], 4);
-  } else {
-      // Default UID if no card selected or invalid index
-      memset(chip->uid, 0, 4);
+  for (size_t i = 0; i < NUM_CARD_TEMPLATES - 1; i++) {
+    chip->card_type_attr_ids[i] = attr_init(CARD_TYPE_ATTR_NAMES[i], CARD_CLASSIC_1K);
+    chip->card_magic_attr_ids[i] = attr_init(CARD_MAGIC_ATTR_NAMES[i], MAGIC_GEN1A);
   }
 
+  // UID and card memory come from the shared template of the selected card, in the format of the slot's card type
+  load_card(chip);
+
   // Initialize registers, set version reg to typical MFRC522 version
   chip->registers[VERSION_REG] = 0x92;
 
   printf("INIT, UID %02X %02X %02X %02X\n",
     chip->uid[0], chip->uid[1], chip->uid[2], chip->uid[3]);
 
-  // Initialize card data with default MIFARE Classic 1K structure
-  memset(chip->card_data, 0, sizeof(chip->card_data));
-
-  // Populate Block 0 (Manufacturer Block) with UID and BCC
-  chip->card_data[0] = chip->uid[0];
-  chip->card_data[1] = chip->uid[1];
-  chip->card_data[2] = chip->uid[2];
-  chip->card_data[3] = chip->uid[3];
-  chip->card_data[4] = chip->uid[0] ^ chip->uid[1] ^ chip->uid[2] ^ chip->uid[3]; // BCC
-  // The rest of block 0 is manufacturer data, can be left as 0.
-
-  // Populate all sector trailers with default keys and access bits.
-  // This mimics a fresh MIFARE Classic card.
-  const uint8_t default_trailer[16] = {
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // Key A
-    0xFF, 0x07, 0x80,                   // Access Bits (default configuration)
-    0x69,                               // User Data Byte (GPB)
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // Key B
-  };
-
-  // MIFARE Classic 1K has 16 sectors.
-  for (int sector = 0; sector < 16; sector++) {
-    // The trailer is the last block of the sector (block 3).
-    int trailer_block_index = sector * 4 + 3;
-    memcpy(&chip->card_data[trailer_block_index * 16], default_trailer, 16);
-  }
-
   // Setup pin watching and SPI
   pin_watch_config_t watch_cfg = {
     .edge = BOTH,
@@ -262,6 +704,59 @@ void chip_init(void) {
   };
   pin_watch(chip->cs_pin, &watch_cfg);
 
+  // NRSTPD: LOW = hard power-down, rising edge = hard reset
+  chip->rst_pin = pin_init("RST", INPUT);
+  pin_watch(chip->rst_pin, &watch_cfg);
+  chip->skip_osc_startup_attr_id = attr_init("skipOscStartup", 0);
+  timer_config_t timer_cfg = {
+    .callback = chip_osc_ready,
+    .user_data = chip,
+  };
+  chip->osc_timer = timer_init(&timer_cfg);
+  timer_config_t pcd_timer_cfg = {
+    .callback = chip_pcd_step,
+    .user_data = chip,
+  };
+  chip->pcd_timer = timer_init(&pcd_timer_cfg);
+
+  for (int i = 0; i < 5; i++) {
+    chip->current_attr_ids[i] = attr_init(CURRENT_ATTR_NAMES[i], CURRENT_DEFAULTS_UA[i]);
+  }
+  chip->energy_report_attr_id = attr_init("energyReportMs", 10000);
+  chip->card_power_up_attr_id = attr_init("cardPowerUpUs", 5000);
+  chip->card_distance_attr_id = attr_init("cardDistance", 0);
+
+  chip->fault_types_attr_id = attr_init("faultTypes", 0);
+  chip->fault_per_mille_attr_id = attr_init("faultPerMille", 0);
+  chip->fault_every_attr_id = attr_init("faultEvery", 0);
+  chip->fault_command_attr_id = attr_init("faultCommand", 0);
+  chip->fault_rng = attr_read(attr_init("faultSeed", 1));
+  if (chip->fault_rng == 0) {
+    chip->fault_rng = 1; // xorshift32 never leaves 0
+  }
+
+  chip->tap_scenario = attr_read(attr_init("tapScenario", 0));
+  if (chip->tap_scenario >= NUM_TAP_SCENARIOS) {
+    chip->tap_scenario = 0;
+  }
+  if (chip->tap_scenario) {
+    timer_config_t tap_timer_cfg = {
+      .callback = chip_tap_step,
+      .user_data = chip,
+    };
+    chip->tap_timer = timer_init(&tap_timer_cfg);
+    // The scenario owns the card: the field stays empty until the first step
+    chip->selected_card_index = 0;
+    load_card(chip);
+    timer_start(chip->tap_timer, attr_read(attr_init("tapStartMs", 1000)) * 1000, false);
+    printf("Chip %u tap scenario: %s\n", chip->instance_id, TAP_SCENARIOS[chip->tap_scenario].name);
+  }
+  timer_config_t energy_timer_cfg = {
+    .callback = chip_energy_report,
+    .user_data = chip,
+  };
+  chip->energy_timer = timer_init(&energy_timer_cfg);
+
   spi_config_t spi_cfg = {
     .sck = pin_init("SCK", INPUT),
     .miso = pin_init("MISO", INPUT),
@@ -271,6 +766,10 @@ void chip_init(void) {
   };
   chip->spi = spi_init(&spi_cfg);
 
+  // IRQ output, idle high (ComIEnReg.IRqInv = 1 after reset)
+  chip->irq_pin = pin_init("IRQ", OUTPUT_HIGH);
+  chip->irq_level = HIGH;
+
   // Initialize important registers
   memset(chip->registers, 0, NUM_REGISTERS);
   chip->registers[VERSION_REG] = 0x92;  // Version
@@ -279,27 +778,21 @@ void chip_init(void) {
   chip->registers[0x0A] = 0x00;        // FIFOLevelReg
   chip->registers[0x0C] = 0x80;        // ControlReg (PowerOn=1)
   chip->registers[0x26] = 0x70;        // RFCfgReg (default to 48dB gain)
+  chip->registers[0x02] = 0x80;        // ComIEnReg (IRqInv=1, all interrupts disabled)
   
   // Clear FIFO
   chip->fifo_len = 0;
   memset(chip->fifo, 0, FIFO_SIZE);
   
   // Initialize state
-  chip->card_selected = false;
-  chip->authenticated = false;
-  chip->anticoll_step = 0;
-  chip->uid_read_completed = false;
-  chip->cascade_level = 1;
-  chip->current_level_known_bits = 0;
-  chip->select_completed = false;
-  chip->select_response_sent = 0;
+  chip->picc_state = PICC_POWER_OFF;
+  chip->select_level = 0;
   chip->stream_write_to_fifo = false;
   chip->spi_transaction_state = SPI_STATE_IDLE;
   chip->pending_write_block = -1;
   chip->pending_write_len = 0;
   chip->pending_mifare_twostep_command = -1; // NEW
   chip->pending_mifare_twostep_block_addr = 0; // NEW
-  chip->card_was_present = false; // Инициализируем флаг
   
   // Initialize internal data register to all zeros
   memset(chip->internal_data_register, 0, sizeof(chip->internal_data_register));
@@ -312,19 +805,637 @@ void chip_init(void) {
   printf("FIFOLevelReg (0x0A): 0x%02X\n", chip->registers[0x0A]);
   printf("ControlReg (0x0C): 0x%02X\n", chip->registers[0x0C]);
   printf("VersionReg (0x37): 0x%02X\n", chip->registers[VERSION_REG]);
+  report_memory(chip);
+
+  chip->in_reset = pin_read(chip->rst_pin) == LOW;
+  if (chip->in_reset) {
+    printf("RST low at start - hard power-down\n");
+  }
+  chip->state_since_ns = get_sim_nanos();
+  chip->bus_report_ns = chip->state_since_ns;
+  chip->energy_report_due_ns = chip->state_since_ns + attr_read(chip->energy_report_attr_id) * 1000000ULL;
+  update_power_state(chip);
+  update_energy_timer(chip);
+}
+
+// Rising edge on NRSTPD: all registers return to their reset values, FIFO and PICC state are lost.
+// The RF field is off during power-down, so the PICC is back in IDLE as well.
+static void hard_reset(chip_state_t *chip) {
+  memcpy(chip->registers, REGISTER_RESET_VALUES, NUM_REGISTERS);
+  chip->fifo_len = 0;
+  memset(chip->fifo, 0, FIFO_SIZE);
+  pcd_queue_cancel(chip, false);
+  reset_chip_state(chip);
+  chip->registers[0x04] = REGISTER_RESET_VALUES[0x04];
+  chip->stream_write_to_fifo = false;
+  chip->spi_transaction_state = SPI_STATE_IDLE;
+  chip->soft_power_down = false;
+  memset(chip->internal_data_register, 0, sizeof(chip->internal_data_register));
+}
+
+// Oscillator start-up (datasheet 8.8.2), skipped with the skipOscStartup attribute
+static void start_oscillator(chip_state_t *chip) {
+  chip->osc_starting = true;
+  if (attr_read(chip->skip_osc_startup_attr_id)) {
+    chip_osc_ready(chip);
+  } else {
+    timer_start(chip->osc_timer, OSC_STARTUP_US, false);
+  }
+}
+
+// Oscillator is stable: after a hard reset the chip accepts SPI again, after soft power-down
+// CommandReg.PowerDown finally reads 0
+static void chip_osc_ready(void *user_data) {
+  chip_state_t *chip = (chip_state_t *)user_data;
+  chip->osc_starting = false;
+  if (chip->in_reset) {
+    chip->in_reset = false;
+    printf("Hard reset done\n");
+  } else if (chip->soft_power_down) {
+    chip->soft_power_down = false;
+    chip->registers[0x01] &= ~0x10;
+  }
+  update_power_state(chip);
+  poll_selected_card(chip); // Skipped while powered down
+  update_irq_pin(chip);
+}
+
+// Derive the power state from NRSTPD, CommandReg and TxControlReg; log transitions with the simulation time
+static void update_power_state(chip_state_t *chip) {
+  power_state_t state = POWER_ACTIVE;
+  if (chip->in_reset) {
+    state = POWER_HARD_DOWN;
+  } else if (chip->soft_power_down) {
+    state = POWER_SOFT_DOWN;
+  } else if ((chip->registers[0x01] & 0x20) || !(chip->registers[0x14] & 0x03)) {
+    state = POWER_ANALOG_OFF;
+  }
+  bool field_on = !chip->in_reset && !chip->soft_power_down && (chip->registers[0x14] & 0x03);
+  if (field_on != chip->field_on) {
+    chip->field_on = field_on;
+    if (field_on) {
+      chip->field_on_ns = get_sim_nanos();
+    } else {
+      card_power_off(chip);
+    }
+  }
+  if (state != chip->power_state) {
+    printf("Chip %u power: %s -> %s at %u us\n", chip->instance_id,
+           POWER_STATE_NAMES[chip->power_state], POWER_STATE_NAMES[state], (unsigned)(get_sim_nanos() / 1000));
+    account_power(chip);
+    bool was_down = chip->power_state >= POWER_SOFT_DOWN;
+    chip->power_state = state;
+    if (was_down != (state >= POWER_SOFT_DOWN)) {
+      update_energy_timer(chip);
+    }
+  }
+}
+
+// The field is gone: the PICC loses power and all its state, it answers REQA again once powered
+static void card_power_off(chip_state_t *chip) {
+  set_picc_state(chip, PICC_POWER_OFF);
+}
+
+// The only place the PICC state changes. Per-state data does not survive leaving its state.
+static void set_picc_state(chip_state_t *chip, picc_state_t state) {
+  if (state == PICC_HALT) {
+    chip->picc_halted = true;
+  } else if (state == PICC_IDLE || state == PICC_POWER_OFF) {
+    chip->picc_halted = false;
+  }
+  if (state != PICC_READY) {
+    chip->select_level = 0;
+  }
+  if ((chip->picc_state == PICC_ACTIVE || chip->picc_state == PICC_AUTHENTICATED) &&
+      state != PICC_ACTIVE && state != PICC_AUTHENTICATED) {
+    chip->personality->halt(chip);
+  }
+  if (state != chip->picc_state) {
+    chip->uid_backdoor_open = false;
+  }
+  chip->picc_state = state;
+}
+
+// A frame the current state does not expect
+static void picc_fall_back(chip_state_t *chip) {
+  set_picc_state(chip, chip->picc_halted ? PICC_HALT : PICC_IDLE);
+}
+
+#ifdef DISPATCH_BENCH_FRAMES
+static uint64_t host_nanos(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Classification without the table: the card type selects the function, as the switch did before the personalities
+static frame_type_t classify_by_switch(chip_state_t *chip) {
+  switch (chip->personality - CARD_PERSONALITIES) {
+    case CARD_CLASSIC_1K:
+    case CARD_CLASSIC_4K: return classic_classify(chip);
+    case CARD_ULTRALIGHT: return ultralight_classify(chip);
+    case CARD_NTAG213: return ntag_classify(chip);
+    case CARD_ISO_DEP: return iso_dep_classify(chip);
+    default: return FRAME_UNKNOWN;
+  }
+}
+
+// classify() has no side effects, so the frame in the FIFO can be classified any number of times. The volatile
+// pointer keeps the compiler from hoisting the loop-invariant calls out of the loops.
+static void dispatch_bench(chip_state_t *chip) {
+  chip_state_t *volatile target = chip;
+  volatile frame_type_t sink;
+  uint64_t start = host_nanos();
+  for (uint32_t i = 0; i < DISPATCH_BENCH_FRAMES; i++) {
+    sink = target->personality->classify(target);
+  }
+  uint64_t middle = host_nanos();
+  for (uint32_t i = 0; i < DISPATCH_BENCH_FRAMES; i++) {
+    sink = classify_by_switch(target);
+  }
+  chip->bench_switch_ns += host_nanos() - middle;
+  chip->bench_table_ns += middle - start;
+  chip->bench_frames += DISPATCH_BENCH_FRAMES;
+  (void)sink;
+}
+#endif
+
+// The personality classifies first: the second part of a two-part command may start with any byte
+static frame_type_t classify_frame(chip_state_t *chip) {
+#ifdef DISPATCH_BENCH_FRAMES
+  dispatch_bench(chip);
+#endif
+  chip->personality_calls++;
+  frame_type_t frame = chip->personality->classify(chip);
+  if (frame != FRAME_UNKNOWN) {
+    return frame;
+  }
+  switch (chip->fifo[0]) {
+    case CMD_REQA: return FRAME_REQA;
+    case CMD_WUPA: return FRAME_WUPA;
+    case CMD_SEL_CL1:
+    case CMD_SEL_CL2:
+    case CMD_SEL_CL3: return FRAME_SELECT;
+    case CMD_HLTA: return FRAME_HLTA;
+    default: return FRAME_UNKNOWN;
+  }
+}
+
+// Looks the frame up in PICC_TRANSITIONS. Returns true if it is to be processed, otherwise the PICC does
+// not answer: the FIFO is cleared and the PICC state updated.
+static bool picc_accepts(chip_state_t *chip, frame_type_t frame) {
+  if (chip->picc_state == PICC_POWER_OFF && chip->selected_card_index) {
+    set_picc_state(chip, PICC_IDLE); // Powered up since the last frame, see card_answers()
+  }
+  uint8_t action = PICC_TRANSITIONS[chip->picc_state][frame];
+  if (action == PICC_HANDLE) {
+    return true;
+  }
+  if (action == PICC_FALL_BACK) {
+    printf("PICC in state %s does not expect frame 0x%02X, falls back to %s\n", PICC_STATE_NAMES[chip->picc_state],
+           chip->fifo[0], chip->picc_halted ? "halt" : "idle");
+    picc_fall_back(chip);
+  }
+  chip->fifo_len = 0;
+  update_fifo_level_register(chip);
+  return false;
+}
+
+// Can the PICC answer: field on long enough to power it, receiver on and the PICC close enough to be powered.
+// Whether the answer is received cleanly depends on the link margin, see apply_link_quality().
+static bool card_answers(chip_state_t *chip) {
+  if (chip->power_state != POWER_ACTIVE) {
+    return false;
+  }
+  uint64_t powered_since = chip->field_on_ns > chip->card_arrival_ns ? chip->field_on_ns : chip->card_arrival_ns;
+  if (get_sim_nanos() - powered_since < attr_read(chip->card_power_up_attr_id) * 1000ULL) {
+    return false;
+  }
+  return attr_read(chip->card_distance_attr_id) <= CARD_POWER_RANGE_MM;
+}
+
+// RxGain above the gain the card distance needs, in dB
+static int link_margin_db(chip_state_t *chip) {
+  uint32_t distance = attr_read(chip->card_distance_attr_id);
+  uint32_t step = distance / 5;
+  int required;
+  if (step >= sizeof(REQUIRED_GAIN_DB) - 1) {
+    required = REQUIRED_GAIN_DB[sizeof(REQUIRED_GAIN_DB) - 1];
+  } else {
+    required = REQUIRED_GAIN_DB[step] + (REQUIRED_GAIN_DB[step + 1] - REQUIRED_GAIN_DB[step]) * (int)(distance % 5) / 5;
+  }
+  return RX_GAIN_DB[(chip->registers[0x26] >> 4) & 0x07] - required;
+}
+
+// Receive the PICC answer over the link: with a margin of 6 dB or more it is clean. Below, each byte has a
+// (6 - margin) * 1.5 % chance of a bit error (ParityErr), and below 0 dB the answer is lost more and more often
+// until nothing is received at -6 dB.
+static void apply_link_quality(chip_state_t *chip) {
+  int margin = link_margin_db(chip);
+  if (chip->fifo_len == 0 || margin >= 6) {
+    return;
+  }
+  if (margin < 0 && (int)(next_random(chip) % 6) < -margin) {
+    apply_fault(chip, FAULT_NO_RESPONSE);
+    return;
+  }
+  uint32_t byte_error_per_mille = (6 - margin) * 15;
+  for (uint8_t i = 0; i < chip->fifo_len; i++) {
+    if (next_random(chip) % 1000 < byte_error_per_mille) {
+      chip->fifo[i] ^= 1 << (next_random(chip) % 8);
+      apply_fault(chip, FAULT_PARITY);
+      return;
+    }
+  }
+}
+
+// Add the time since the last call to the current power state
+static void account_power(chip_state_t *chip) {
+  uint64_t now = get_sim_nanos();
+  chip->state_ns[chip->power_state] += now - chip->state_since_ns;
+  chip->state_since_ns = now;
+}
+
+// Air time of one PICC exchange. The emulator answers at once, so it is estimated from the frame lengths.
+static void account_transceive(chip_state_t *chip, uint8_t tx_bytes, uint8_t rx_bytes) {
+  chip->transceive_ns += (tx_bytes + rx_bytes) * AIR_BYTE_NS;
+}
+
+// Current value of an energy_item_t, see ENERGY_SEL_REG
+static uint32_t energy_item(chip_state_t *chip, uint8_t item) {
+  if (item == ENERGY_SPI_TRANSACTIONS) {
+    return chip->spi_transactions;
+  }
+  if (item == ENERGY_SPI_BYTES) {
+    return chip->spi_bytes;
+  }
+  if (item == ENERGY_SPI_CS_LOW_US) {
+    return (uint32_t)(chip->spi_cs_low_ns / 1000);
+  }
+  account_power(chip);
+  uint64_t ns[5];
+  memcpy(ns, chip->state_ns, sizeof(chip->state_ns));
+  ns[ENERGY_TRANSCEIVE_MS] = chip->transceive_ns < ns[ENERGY_ANTENNA_MS] ? chip->transceive_ns : ns[ENERGY_ANTENNA_MS];
+  ns[ENERGY_ANTENNA_MS] -= ns[ENERGY_TRANSCEIVE_MS];
+  if (item < ENERGY_CHARGE_UAH) {
+    return (uint32_t)(ns[item] / 1000000);
+  }
+  double charge_uas = 0; // uA * s
+  uint64_t total_ns = 0;
+  for (int i = 0; i < 5; i++) {
+    charge_uas += (double)ns[i] / 1e9 * attr_read(chip->current_attr_ids[i]);
+    total_ns += ns[i];
+  }
+  if (item == ENERGY_CHARGE_UAH) {
+    return (uint32_t)(charge_uas / 3600);
+  }
+  if (item == ENERGY_AVERAGE_UA && total_ns) {
+    return (uint32_t)(charge_uas * 1e9 / total_ns);
+  }
+  return 0;
+}
+
+// The summary timer stops in power-down like everything else. A summary that fell due meanwhile
+// is printed on wake-up, so duty-cycled firmware still gets one per period.
+static void update_energy_timer(chip_state_t *chip) {
+  timer_stop(chip->energy_timer);
+  if (!attr_read(chip->energy_report_attr_id) || chip->power_state >= POWER_SOFT_DOWN) {
+    return;
+  }
+  uint64_t now = get_sim_nanos();
+  if (chip->energy_report_due_ns <= now) {
+    chip_energy_report(chip);
+  } else {
+    timer_start_ns(chip->energy_timer, chip->energy_report_due_ns - now, false);
+  }
+}
+
+static void chip_energy_report(void *user_data) {
+  chip_state_t *chip = (chip_state_t *)user_data;
+  uint32_t period_ms = attr_read(chip->energy_report_attr_id);
+  if (!period_ms) {
+    return;
+  }
+  uint32_t average_ua = energy_item(chip, ENERGY_AVERAGE_UA);
+  printf("Chip %u energy at %u ms: antenna %u ms, transceive %u ms, idle %u ms, soft PD %u ms, hard PD %u ms; "
+         "%u uAh, average %u uA = %u.%03u mAh/day\n",
+         chip->instance_id, (unsigned)(get_sim_nanos() / 1000000),
+         (unsigned)energy_item(chip, ENERGY_ANTENNA_MS), (unsigned)energy_item(chip, ENERGY_TRANSCEIVE_MS),
+         (unsigned)energy_item(chip, ENERGY_IDLE_MS), (unsigned)energy_item(chip, ENERGY_SOFT_DOWN_MS),
+         (unsigned)energy_item(chip, ENERGY_HARD_DOWN_MS), (unsigned)energy_item(chip, ENERGY_CHARGE_UAH),
+         (unsigned)average_ua, (unsigned)(average_ua * 24 / 1000), (unsigned)(average_ua * 24 % 1000));
+  report_bus(chip);
+  report_frames(chip);
+  chip->energy_report_due_ns = get_sim_nanos() + period_ms * 1000000ULL;
+  update_energy_timer(chip);
+}
+
+// SPI traffic since the last summary. A reader polling for cards spends its idle time here.
+static void report_bus(chip_state_t *chip) {
+  uint64_t now = get_sim_nanos();
+  uint64_t period_ns = now - chip->bus_report_ns;
+  uint64_t cs_low_ns = chip->spi_cs_low_ns - chip->bus_report_cs_low_ns;
+  uint32_t per_10000 = period_ns ? (uint32_t)(cs_low_ns * 10000 / period_ns) : 0;
+  printf("Chip %u bus at %u ms: %u transactions, %u bytes, CS low %u us in %u ms = %u.%02u%%\n",
+         chip->instance_id, (unsigned)(now / 1000000),
+         (unsigned)(chip->spi_transactions - chip->bus_report_transactions),
+         (unsigned)(chip->spi_bytes - chip->bus_report_bytes), (unsigned)(cs_low_ns / 1000),
+         (unsigned)(period_ns / 1000000), (unsigned)(per_10000 / 100), (unsigned)(per_10000 % 100));
+  chip->bus_report_transactions = chip->spi_transactions;
+  chip->bus_report_bytes = chip->spi_bytes;
+  chip->bus_report_cs_low_ns = chip->spi_cs_low_ns;
+  chip->bus_report_ns = now;
+}
+
+// PICC frames since the last summary: one personality call classifies each frame, the card's own frames take a
+// second one to reach its handler; the ISO 14443-3 frames are handled without it
+static void report_frames(chip_state_t *chip) {
+  printf("Chip %u frames at %u ms: %u ISO 14443-3, %u to the %s card, %u personality calls\n",
+         chip->instance_id, (unsigned)(get_sim_nanos() / 1000000), (unsigned)chip->frames_iso,
+         (unsigned)chip->frames_card, chip->personality->name, (unsigned)chip->personality_calls);
+  chip->frames_iso = 0;
+  chip->frames_card = 0;
+  chip->personality_calls = 0;
+#ifdef DISPATCH_BENCH_FRAMES
+  if (chip->bench_frames) {
+    uint32_t table_ns10 = (uint32_t)(chip->bench_table_ns * 10 / chip->bench_frames);
+    uint32_t switch_ns10 = (uint32_t)(chip->bench_switch_ns * 10 / chip->bench_frames);
+    printf("Chip %u dispatch: %u.%u ns per frame through the personality table, %u.%u ns through a switch "
+           "(%u classifications each)\n", chip->instance_id, (unsigned)(table_ns10 / 10), (unsigned)(table_ns10 % 10),
+           (unsigned)(switch_ns10 / 10), (unsigned)(switch_ns10 % 10), (unsigned)chip->bench_frames);
+  }
+  chip->bench_table_ns = 0;
+  chip->bench_switch_ns = 0;
+  chip->bench_frames = 0;
+#endif
+}
+
+// Read selected card from Wokwi control and update UID if changed
+static void poll_selected_card(chip_state_t *chip) {
+  if (chip->tap_scenario) {
+    return; // The scenario moves the cards
+  }
+  uint8_t new_selected_card_index = attr_read(chip->selected_card_attr_id);
+  if (new_selected_card_index != chip->selected_card_index) {
+      change_card(chip, new_selected_card_index);
+  }
+}
+
+// A card leaves the field and/or another one enters it; both end and start a tap
+static void change_card(chip_state_t *chip, uint8_t card) {
+  uint64_t now = get_sim_nanos();
+  if (chip->tap_open) {
+    chip->tap_open = false;
+    chip->taps++;
+    if (!chip->tap_seen) {
+      chip->taps_missed++;
+      printf("Chip %u tap %u missed: card %u left after %u ms without being selected\n", chip->instance_id,
+             (unsigned)chip->taps, chip->selected_card_index, (unsigned)((now - chip->card_arrival_ns) / 1000000));
+    }
+    if (chip->taps % TAP_SUMMARY_EVERY == 0) {
+      report_taps(chip);
+    }
+  }
+
+  chip->selected_card_index = card;
+  card_power_off(chip); // Карта убрана или новая — сбросить флаг
+  // New card: fresh content from its template
+  load_card(chip);
+  chip->card_arrival_ns = now;
+  if (chip->selected_card_index) {
+    chip->tap_open = true;
+    chip->tap_seen = false;
+  }
+  if (!chip->tap_scenario) {
+    printf("Selected card changed to: %d\n", chip->selected_card_index);
+  }
+}
+
+// Next step of the tap scenario. Cards move in the real world, so this timer keeps running in power-down.
+static void chip_tap_step(void *user_data) {
+  chip_state_t *chip = (chip_state_t *)user_data;
+  const tap_scenario_t *scenario = &TAP_SCENARIOS[chip->tap_scenario];
+  const tap_step_t *step = &scenario->steps[chip->tap_step];
+  if (step->card != chip->selected_card_index) {
+    change_card(chip, step->card);
+  }
+  chip->tap_step = (chip->tap_step + 1) % scenario->step_count;
+  timer_start(chip->tap_timer, step->duration_ms * 1000, false);
+}
+
+// SELECT of the card in the field: first one of a tap gives the tap-to-UID latency
+static void tap_selected(chip_state_t *chip) {
+  if (!chip->tap_open || chip->tap_seen) {
+    return;
+  }
+  chip->tap_seen = true;
+  uint64_t latency = get_sim_nanos() - chip->card_arrival_ns;
+  if (chip->taps == chip->taps_missed || latency < chip->tap_latency_min_ns) { // No earlier tap seen
+    chip->tap_latency_min_ns = latency;
+  }
+  if (latency > chip->tap_latency_max_ns) {
+    chip->tap_latency_max_ns = latency;
+  }
+  chip->tap_latency_sum_ns += latency;
+}
+
+// Damage the answer of the PICC exchange that just ran, see FAULT_*
+static void inject_fault(chip_state_t *chip, uint8_t command) {
+  uint8_t types = attr_read(chip->fault_types_attr_id) & ((1 << NUM_FAULT_TYPES) - 1);
+  uint8_t only_command = attr_read(chip->fault_command_attr_id);
+  if (!types || chip->fifo_len == 0 || (only_command && only_command != command)) {
+    return;
+  }
+  chip->fault_exchanges++;
+  uint32_t every = attr_read(chip->fault_every_attr_id);
+  if (every) {
+    if (chip->fault_exchanges % every) {
+      return;
+    }
+  } else if (next_random(chip) % 1000 >= attr_read(chip->fault_per_mille_attr_id)) {
+    return;
+  }
+
+  uint8_t type;
+  do {
+    type = chip->fault_next_type;
+    chip->fault_next_type = (type + 1) % NUM_FAULT_TYPES;
+  } while (!(types & (1 << type)));
+  chip->faults_injected++;
+  printf("Chip %u fault %u of %u exchanges: %s on command 0x%02X\n", chip->instance_id,
+         (unsigned)chip->faults_injected, (unsigned)chip->fault_exchanges, FAULT_NAMES[type], command);
+  apply_fault(chip, 1 << type);
+}
+
+// xorshift32 shared by the fault injector and the link model, seeded with faultSeed
+static uint32_t next_random(chip_state_t *chip) {
+  chip->fault_rng ^= chip->fault_rng << 13;
+  chip->fault_rng ^= chip->fault_rng >> 17;
+  chip->fault_rng ^= chip->fault_rng << 5;
+  return chip->fault_rng;
+}
+
+// Damage the answer in the FIFO with one FAULT_* kind
+static void apply_fault(chip_state_t *chip, uint8_t fault) {
+  switch (fault) {
+    case FAULT_CRC:
+      chip->fifo[chip->fifo_len - 1] ^= 0x01;
+      chip->registers[0x06] |= 0x04; // CRCErr
+      break;
+    case FAULT_PARITY:
+      chip->registers[0x06] |= 0x02; // ParityErr
+      break;
+    case FAULT_PROTOCOL:
+      chip->registers[0x06] |= 0x01; // ProtocolErr
+      break;
+    case FAULT_COLLISION:
+      chip->registers[0x06] |= 0x08; // CollErr
+      chip->registers[0x0E] |= 0x20; // CollPosNotValid
+      break;
+    case FAULT_BUFFER_OVFL:
+      chip->registers[0x06] |= 0x10; // BufferOvfl
+      break;
+    case FAULT_NO_RESPONSE:
+      chip->fifo_len = 0;
+      update_fifo_level_register(chip);
+      clear_irq_flag(chip, 0x20);        // RxIRq
+      set_specific_irq_flag(chip, 0x01); // TimerIRq
+      return;
+    case FAULT_NAK:
+      chip->fifo[0] = 0x00;             // NAK: invalid operation
+      chip->fifo_len = 1;
+      update_fifo_level_register(chip);
+      chip->registers[0x0C] = (chip->registers[0x0C] & ~0x07) | 0x04; // RxLastBits = 4
+      return;
+  }
+  set_specific_irq_flag(chip, 0x02); // ErrIRq
+}
+
+static void report_taps(chip_state_t *chip) {
+  uint32_t seen = chip->taps - chip->taps_missed;
+  printf("Chip %u taps at %u ms: %u taps, %u missed (%u.%u%%), tap-to-UID min %u us, avg %u us, max %u us\n",
+         chip->instance_id, (unsigned)(get_sim_nanos() / 1000000), (unsigned)chip->taps, (unsigned)chip->taps_missed,
+         (unsigned)(chip->taps_missed * 100 / chip->taps), (unsigned)(chip->taps_missed * 1000 / chip->taps % 10),
+         (unsigned)(seen ? chip->tap_latency_min_ns / 1000 : 0),
+         (unsigned)(seen ? chip->tap_latency_sum_ns / seen / 1000 : 0),
+         (unsigned)(chip->tap_latency_max_ns / 1000));
+}
+
+// Switch to the template of chip->selected_card_index and the personality of the slot's card type (the
+// cardNType attribute is read on every card change). A private copy of an earlier card is dropped
+// (its buffer is kept for the next copy-on-write).
+static void load_card(chip_state_t *chip) {
+  if (chip->selected_card_index >= NUM_CARD_TEMPLATES) {
+    chip->selected_card_index = 0;
+  }
+  uint32_t type = CARD_CLASSIC_1K;
+  uint32_t magic = MAGIC_NONE;
+  if (chip->selected_card_index) {
+    type = attr_read(chip->card_type_attr_ids[chip->selected_card_index - 1]);
+    magic = attr_read(chip->card_magic_attr_ids[chip->selected_card_index - 1]);
+  }
+  chip->personality = &CARD_PERSONALITIES[type < CARD_TYPES ? type : CARD_CLASSIC_1K];
+  chip->card_magic = magic < MAGIC_TYPES ? magic : MAGIC_NONE;
+  chip->card_dirty = false;
+  chip->personality->load(chip, &CARD_TEMPLATES[chip->selected_card_index]);
+}
+
+// Current content of a card block (block < personality->blocks), read only
+static const uint8_t *card_block(chip_state_t *chip, uint8_t block) {
+  if (chip->card_dirty) {
+    return &chip->card_data[block * 16];
+  }
+  if (block == 0) {
+    return chip->fresh_block0;
+  }
+  return chip->personality->fresh_block(chip, block);
+}
+
+// Card block to be modified: the first write copies the template into the instance's own card memory.
+// NULL if that memory cannot be allocated; the card then refuses the write and keeps its template data.
+static uint8_t *card_block_mut(chip_state_t *chip, uint8_t block) {
+  if (!chip->card_dirty) {
+    bool allocated = false;
+    uint16_t size = chip->personality->blocks * 16;
+    if (chip->card_data_size < size) {
+      free(chip->card_data);
+      chip->card_data = malloc(size);
+      if (chip->card_data == NULL) {
+        printf("Chip %u: out of memory for a %u byte card copy, write refused\n", chip->instance_id, size);
+        chip->card_data_size = 0;
+        return NULL;
+      }
+      chip->card_data_size = size;
+      allocated = true;
+    }
+    for (uint16_t b = 0; b < chip->personality->blocks; b++) {
+      memcpy(&chip->card_data[b * 16], card_block(chip, b), 16);
+    }
+    chip->card_dirty = true;
+    if (allocated) {
+      report_memory(chip);
+    }
+  }
+  return &chip->card_data[block * 16];
+}
+
+// Stores len bytes at the start of a card block. false if the card memory could not be allocated.
+static bool card_write(chip_state_t *chip, uint8_t block, const uint8_t *data, uint8_t len) {
+  uint8_t *dest = card_block_mut(chip, block);
+  if (dest == NULL) {
+    return false;
+  }
+  memcpy(dest, data, len);
+  return true;
+}
+
+// Memory budget of one instance: its own state plus the private card copy, if any.
+// Templates and constants are shared by all instances.
+static void report_memory(chip_state_t *chip) {
+  size_t card = chip->card_data_size;
+  printf("Chip %u memory: state %u bytes + card %u bytes = %u bytes (shared templates %u bytes)\n",
+         chip->instance_id, (unsigned)sizeof(chip_state_t), (unsigned)card,
+         (unsigned)(sizeof(chip_state_t) + card),
+         (unsigned)(sizeof(CARD_TEMPLATES) + sizeof(BLANK_BLOCK) + sizeof(DEFAULT_TRAILER) +
+                    sizeof(NTAG213_CONFIG_BLOCKS) + sizeof(NTAG213_VERSION) + sizeof(ISO_DEP_ATS) +
+                    sizeof(CARD_PERSONALITIES)));
 }
 
 void chip_pin_change(void *user_data, pin_t pin, uint32_t value) {
   chip_state_t *chip = (chip_state_t *)user_data;
+  if (pin == chip->rst_pin) {
+    if (value == LOW) {
+      // Hard power-down: oscillator off, SPI inputs disconnected, IRQ output frozen
+      timer_stop(chip->osc_timer);
+      spi_stop(chip->spi);
+      pcd_queue_cancel(chip, false); // Running and queued commands stop with the oscillator, pcd_timer too
+      chip->in_reset = true;
+      chip->osc_starting = false;
+      update_power_state(chip);
+    } else {
+      hard_reset(chip);
+      start_oscillator(chip);
+    }
+    return;
+  }
   if (pin == chip->cs_pin) {
+    if (value == LOW) {
+      chip->spi_transactions++;
+      chip->spi_cs_low_since_ns = get_sim_nanos();
+    } else if (chip->spi_cs_low_since_ns) {
+      chip->spi_cs_low_ns += get_sim_nanos() - chip->spi_cs_low_since_ns;
+      chip->spi_cs_low_since_ns = 0;
+    }
+    if (chip->in_reset) {
+      return; // In reset: SPI is ignored, MISO stays low
+    }
     if (value == LOW) {
       chip->spi_transaction_state = SPI_STATE_IDLE;
       spi_start(chip->spi, chip->spi_buffer, 1);
     } else {
       spi_stop(chip->spi);
-      // Do NOT reset anticoll_step here. It must be preserved across transactions
-      // during card selection sequence. It will be reset by REQA/WUPA or SELECT completion.
-      // chip->anticoll_step = 0;
+      // Do NOT reset select_level here. It must be preserved across transactions
+      // during card selection sequence. set_picc_state() clears it when the PICC leaves READY.
       chip->stream_write_to_fifo = false;
     }
   }
@@ -332,36 +1443,14 @@ void chip_pin_change(void *user_data, pin_t pin, uint32_t value) {
 
 void chip_spi_done(void *user_data, uint8_t *buffer, uint32_t count) {
   chip_state_t *chip = (chip_state_t*)user_data;
+  chip->spi_bytes += count;
+  if (chip->in_reset) {
+    return; // Hard power-down or oscillator start-up
+  }
 
-  // NEW: Read selected card from Wokwi control and update UID if changed
-  uint8_t new_selected_card_index = attr_read(chip->selected_card_attr_id);
-  if (new_selected_card_index != chip->selected_card_index) {
-      chip->selected_card_index = new_selected_card_index;
-      if (chip->selected_card_index > 0 && chip->selected_card_index <= 5) {
-          memcpy(chip->uid, CARD_UIDS[chip->selected_card_index - 1], 4);
-          chip->card_was_present = false; // Карта убрана или новая — сбросить флаг
-      } else {
-          memset(chip->uid, 0, 4);
-          chip->card_was_present = false; // Карта убрана — сбросить флаг
-      }
-      printf("Selected card changed to: %d\n", chip->selected_card_index);
-      // Reinitialize card data for new card
-      memset(chip->card_data, 0, sizeof(chip->card_data));
-      chip->card_data[0] = chip->uid[0];
-      chip->card_data[1] = chip->uid[1];
-      chip->card_data[2] = chip->uid[2];
-      chip->card_data[3] = chip->uid[3];
-      chip->card_data[4] = chip->uid[0] ^ chip->uid[1] ^ chip->uid[2] ^ chip->uid[3]; // BCC
-      const uint8_t default_trailer[16] = {
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, // Key A
-        0xFF, 0x07, 0x80,                   // Access Bits (default configuration)
-        0x69,                               // User Data Byte (GPB)
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF  // Key B
-      };
-      for (int sector = 0; sector < 16; sector++) {
-        int trailer_block_index = sector * 4 + 3;
-        memcpy(&chip->card_data[trailer_block_index * 16], default_trailer, 16);
-      }
+  // The RF field is ignored in soft power-down, the card is looked at again on wake-up
+  if (chip->power_state != POWER_SOFT_DOWN) {
+    poll_selected_card(chip);
   }
 
   if (pin_read(chip->cs_pin) == HIGH) {
@@ -402,54 +1491,54 @@ void chip_spi_done(void *user_data, uint8_t *buffer, uint32_t count) {
       uint8_t data_byte = buffer[0];
       handle_spi_write_command(chip, data_byte);
 
-      if (chip->stream_write_to_fifo) {
-        chip->spi_transaction_state = SPI_STATE_WAIT_DATA;
-    spi_start(chip->spi, chip->spi_buffer, 1);
-  } else {
-        chip->spi_transaction_state = SPI_STATE_IDLE;
-      }
+      // Как у настоящего чипа (datasheet 8.1.2.2): все следующие байты до подъёма CS
+      // пишутся в тот же регистр, не только в FIFODataReg
+      chip->spi_transaction_state = SPI_STATE_WAIT_DATA;
+      spi_start(chip->spi, chip->spi_buffer, 1);
       break;
     }
   }
+
+  update_power_state(chip);
+  update_irq_pin(chip);
 }
 
 // MIFARE command processing functions
 static void handle_reqa_wupa_command(chip_state_t *chip) {
   // Only respond if a card is selected (index > 0)
   if (chip->selected_card_index > 0) {
-      if (!chip->card_was_present) {
-          chip->fifo[0] = 0x04;  // ATQA
-          chip->fifo[1] = 0x00;
-          chip->fifo_len = 2;
-          update_fifo_level_register(chip);
-          // Устанавливаем только RxIRq для успешного приема данных
+      // Состояние уже проверено по PICC_TRANSITIONS: REQA из IDLE, WUPA из IDLE или HALT
+      chip->fifo[0] = chip->personality->atqa & 0xFF;  // ATQA, младший байт первым
+      chip->fifo[1] = chip->personality->atqa >> 8;
+      chip->fifo_len = 2;
+      update_fifo_level_register(chip);
+      // Устанавливаем только RxIRq для успешного приема данных
       set_specific_irq_flag(chip, 0x20);  // RxIRq (corrected from 0x04)
-          chip->anticoll_step = 0;
-          chip->registers[0x0C] &= ~0x07; // Сброс RxLastBits в 0, так как ATQA - это полные байты
-          chip->card_was_present = true; // Установить флаг: карта обнаружена
-      } else {
-          // Карта уже была обнаружена, не отвечаем повторно
-          chip->fifo_len = 0;
-          update_fifo_level_register(chip);
-      }
+      chip->registers[0x0C] &= ~0x07; // Сброс RxLastBits в 0, так как ATQA - это полные байты
+      set_picc_state(chip, PICC_READY);
   } else {
       chip->fifo_len = 0; // Clear FIFO if no card is selected
       update_fifo_level_register(chip); // Update FIFO level register
   }
 }
 
+// The four UID bytes of cascade level 0-2 (ISO/IEC 14443-3 6.5.4): CT and three UID bytes if another level
+// follows, the last four UID bytes otherwise. false if the UID has no such level.
+static bool cascade_uid(chip_state_t *chip, uint8_t level, uint8_t *bytes) {
+  uint8_t levels = chip->uid_size == 4 ? 1 : 2;
+  if (level >= levels) {
+    return false;
+  }
+  if (level + 1 < levels) {
+    bytes[0] = CMD_CT;
+    memcpy(&bytes[1], &chip->uid[level * 3], 3);
+  } else {
+    memcpy(bytes, &chip->uid[level * 3], 4);
+  }
+  return true;
+}
+
 static void handle_anticoll_command(chip_state_t *chip) {
-//   printf("ANTICOLL command - step: %d, fifo_len: %d\n", chip->anticoll_step, chip->fifo_len);
-//   log_chip_state(chip, "before ANTICOLL processing");
-  
-//   if (chip->fifo_len > 0) {
-//     printf("ANTICOLL fifo content: ");
-//     for (int i = 0; i < chip->fifo_len && i < 4; i++) {
-//       printf("%02X ", chip->fifo[i]);
-//     }
-//     printf("\n");
-//   }
-  
   // Only process if a card is selected
   if (chip->selected_card_index == 0) {
       printf("ANTICOLL - no card selected, no response\n");
@@ -458,40 +1547,28 @@ static void handle_anticoll_command(chip_state_t *chip) {
       return;
   }
 
-  // Обработка ANTICOLLISION для Cascade Level 1
-  if (chip->anticoll_step == 0 && chip->fifo_len >= 1 && chip->fifo[0] == CMD_SEL_CL1) {
-    // Очищаем FIFO перед формированием ответа
+  // ANTICOLLISION отвечает только на текущем уровне каскада
+  uint8_t level = (chip->fifo[0] - CMD_SEL_CL1) / 2;
+  uint8_t bytes[4];
+  if (level != chip->select_level || !cascade_uid(chip, level, bytes)) {
+    printf("ANTICOLL - cascade level %u not expected, falls back\n", level + 1);
     chip->fifo_len = 0;
-    printf("ANTICOLL - responding with UID for card %d\n", chip->selected_card_index);
-    chip->fifo[chip->fifo_len++] = chip->uid[0];
-    chip->fifo[chip->fifo_len++] = chip->uid[1];
-    chip->fifo[chip->fifo_len++] = chip->uid[2];
-    chip->fifo[chip->fifo_len++] = chip->uid[3];
-    uint8_t bcc = chip->uid[0] ^ chip->uid[1] ^ chip->uid[2] ^ chip->uid[3];
-    chip->fifo[chip->fifo_len++] = bcc;  // UID + BCC
     update_fifo_level_register(chip);
-    set_specific_irq_flag(chip, 0x20);  // RxIRq (corrected from 0x04)
-    chip->anticoll_step = 1;
-    chip->current_level_known_bits = 32;  // Все 32 бита известны
-    chip->registers[0x0C] &= ~0x07; // Сброс RxLastBits в 0, так как UID - это полные байты
-//     printf("ANTICOLL processed - UID and BCC in FIFO: ");
-//     for (int i = 0; i < chip->fifo_len; i++) {
-//       printf("%02X ", chip->fifo[i]);
-//     }
-//     printf("\n");
+    picc_fall_back(chip);
+    return;
   }
-  
-//   log_chip_state(chip, "after ANTICOLL processing");
+  // Очищаем FIFO перед формированием ответа
+  chip->fifo_len = 0;
+  printf("ANTICOLL - responding with UID for card %d\n", chip->selected_card_index);
+  memcpy(chip->fifo, bytes, 4);
+  chip->fifo[4] = bytes[0] ^ bytes[1] ^ bytes[2] ^ bytes[3];  // UID + BCC
+  chip->fifo_len = 5;
+  update_fifo_level_register(chip);
+  set_specific_irq_flag(chip, 0x20);  // RxIRq (corrected from 0x04)
+  chip->registers[0x0C] &= ~0x07; // Сброс RxLastBits в 0, так как UID - это полные байты
 }
 
 static void handle_select_command(chip_state_t *chip) {
-//   printf("SELECT command detected - processing full UID selection\n");
-//   printf("SELECT command content: ");
-//   for (int i = 0; i < chip->fifo_len; i++) {
-//     printf("%02X ", chip->fifo[i]);
-//   }
-//   printf("\n");
-
   // Only process if a card is selected
   if (chip->selected_card_index == 0) {
       printf("SELECT - no card selected, no response\n");
@@ -501,60 +1578,174 @@ static void handle_select_command(chip_state_t *chip) {
   }
 
   // Check if this is the correct SELECT command for our UID
-  if (chip->fifo[2] == chip->uid[0] && chip->fifo[3] == chip->uid[1] &&
-      chip->fifo[4] == chip->uid[2] && chip->fifo[5] == chip->uid[3]) {
+  uint8_t level = (chip->fifo[0] - CMD_SEL_CL1) / 2;
+  uint8_t bytes[4] = {0};
+  if (level == chip->select_level && cascade_uid(chip, level, bytes) && memcmp(&chip->fifo[2], bytes, 4) == 0) {
+    // CT: the UID continues on the next cascade level, the SAK only has the cascade bit
+    bool complete = bytes[0] != CMD_CT;
     printf("SELECT - UID match for card %d, sending SAK\n", chip->selected_card_index);
 
     // Clear FIFO before sending SAK
-      chip->fifo_len = 0;
+    chip->fifo_len = 0;
 
     // Send SAK with CRC
-    chip->fifo[0] = 0x08;  // SAK for MIFARE Classic 1K
+    chip->fifo[0] = complete ? chip->personality->sak : 0x04;
     uint8_t crc[2];
     calc_crc_a(chip->fifo, 1, crc);
     chip->fifo[1] = crc[0];
     chip->fifo[2] = crc[1];
     chip->fifo_len = 3;
 
-      update_fifo_level_register(chip);
+    update_fifo_level_register(chip);
     set_specific_irq_flag(chip, 0x20);  // RxIRq (corrected from 0x04)
-
-      chip->card_selected = true;
-    chip->authenticated = false; // Reset authentication state on new selection
-    chip->select_completed = true;
     chip->registers[0x0C] &= ~0x07; // Сброс RxLastBits в 0, так как SAK - это полный байт
-//     printf("SELECT completed - SAK+CRC sent: %02X %02X %02X\n", chip->fifo[0], chip->fifo[1], chip->fifo[2]);
+
+    if (complete) {
+      set_picc_state(chip, PICC_ACTIVE);
+      tap_selected(chip);
+      chip->personality_calls++;
+      chip->personality->activate(chip);
     } else {
+      chip->select_level++;
+    }
+  } else {
     printf("SELECT failed - UID mismatch for card %d\n", chip->selected_card_index);
-    printf("Expected UID: %02X %02X %02X %02X\n",
-           chip->uid[0], chip->uid[1], chip->uid[2], chip->uid[3]);
+    printf("Expected UID: %02X %02X %02X %02X\n", bytes[0], bytes[1], bytes[2], bytes[3]);
     printf("Received UID: %02X %02X %02X %02X\n",
            chip->fifo[2], chip->fifo[3], chip->fifo[4], chip->fifo[5]);
-      chip->fifo_len = 0;
-      update_fifo_level_register(chip);
+    chip->fifo_len = 0;
+    update_fifo_level_register(chip);
+    picc_fall_back(chip); // SELECT of another PICC
+  }
+}
+
+// MFAuthent: FIFO = команда (0x60/0x61), блок, ключ (6 байт), UID (4 байта).
+// Ключ сверяется с ключом A или B в трейлере сектора блока. Карты без Crypto1 не отвечают.
+static void handle_auth_command(chip_state_t *chip) {
+  bool key_ok = false;
+  uint8_t block = chip->fifo[1];
+
+  if (chip->selected_card_index > 0 && card_answers(chip) && picc_accepts(chip, FRAME_AUTH) &&
+      chip->personality->crypto1 && chip->fifo_len >= 8 &&
+      (chip->fifo[0] == CMD_AUTH_A || chip->fifo[0] == CMD_AUTH_B) && block < chip->personality->blocks) {
+    const uint8_t *trailer = card_block(chip, classic_trailer(block));
+    const uint8_t *key = (chip->fifo[0] == CMD_AUTH_A) ? trailer : trailer + 10;
+    key_ok = memcmp(&chip->fifo[2], key, 6) == 0;
+  }
+
+  if (key_ok) {
+    printf("Authentication successful (block 0x%02X, key %c)\n", block, chip->fifo[0] == CMD_AUTH_A ? 'A' : 'B');
+    set_picc_state(chip, PICC_AUTHENTICATED);
+    chip->registers[0x08] |= 0x08;       // Status2Reg: MFCrypto1On
+    // The command completes when IdleIRq is set.
+    set_specific_irq_flag(chip, 0x10);   // IdleIRq
+  } else {
+    // После неверного ключа карта молча возвращается в IDLE (или в HALT, если её разбудили из HALT):
+    // PCD не дожидается ответа и срабатывает таймер. Разбудить её снова можно WUPA.
+    printf("Authentication failed (block 0x%02X), card in state %s\n", block, PICC_STATE_NAMES[chip->picc_state]);
+    if (chip->picc_state == PICC_ACTIVE || chip->picc_state == PICC_AUTHENTICATED) {
+      picc_fall_back(chip);
     }
-  // Reset anticoll_step after SELECT is done
-      chip->anticoll_step = 0;
+    chip->registers[0x08] &= ~0x08;      // Status2Reg: MFCrypto1On
+    set_specific_irq_flag(chip, 0x01);   // TimerIRq
+  }
+  chip->fifo_len = 0; // Clear FIFO after auth attempt
+  update_fifo_level_register(chip);
+  chip->registers[0x01] = 0x00; // Go to Idle
 }
 
 void process_mifare_command(chip_state_t *chip) {
   if (chip->fifo_len == 0) return;
+  if (!card_answers(chip)) {
+    // No field, PICC still powering up or its answer is too weak: same as no card
+    chip->fifo_len = 0;
+    update_fifo_level_register(chip);
+    return;
+  }
+  frame_type_t frame = classify_frame(chip);
+  if (!picc_accepts(chip, frame)) {
+    return;
+  }
+
+  // ISO/IEC 14443-3 frames are the same for every card, the rest belongs to the personality
+  switch (frame) {
+    case FRAME_REQA:
+    case FRAME_WUPA:
+      chip->frames_iso++;
+      handle_reqa_wupa_command(chip);
+      break;
+
+    case FRAME_SELECT:
+      chip->frames_iso++;
+      // Полный SELECT (NVB=0x70) допустим и без предшествующего ANTICOLL, если UID уже известен
+      if (chip->fifo_len >= 9 && chip->fifo[1] == 0x70) {
+        handle_select_command(chip);
+      } else {
+        handle_anticoll_command(chip);
+      }
+      break;
+
+    case FRAME_HLTA:
+      chip->frames_iso++;
+      set_picc_state(chip, PICC_HALT);
+      chip->fifo_len = 0;
+      update_fifo_level_register(chip);
+      printf("HALT command received. Card halted, only WUPA wakes it. No response will be sent.\n");
+      break;
+
+    default:
+      chip->frames_card++;
+      chip->personality_calls++;
+      chip->personality->handle_frame(chip);
+      break;
+  }
+}
+
+// Personality without anything to do for this event
+static void personality_no_op(chip_state_t *chip) {
+  (void)chip;
+}
+
+// MIFARE Classic 1K/4K personality: Crypto1 authentication per sector, 16 byte blocks, value operations.
+// WRITE and the value operations take two frames, the second one is recognised by the pending command.
+static frame_type_t classic_classify(chip_state_t *chip) {
+  if (chip->pending_write_block != -1 || chip->pending_mifare_twostep_command != -1) {
+    return FRAME_MEMORY; // Data part of WRITE or of a value operation
+  }
+  switch (chip->fifo[0]) {
+    case CMD_AUTH_A:
+    case CMD_AUTH_B: return FRAME_AUTH;
+    case CMD_READ:
+    case CMD_WRITE:
+    case CMD_DECREMENT:
+    case CMD_INCREMENT:
+    case CMD_RESTORE:
+    case CMD_TRANSFER: return FRAME_MEMORY;
+    case CMD_UL_WRITE: return FRAME_ULTRALIGHT;
+    case 0x40:
+    case 0x43:
+      // Only cards with the backdoor see these as commands
+      return chip->card_magic == MAGIC_GEN1A || chip->card_magic == MAGIC_LOCKED ? FRAME_BACKDOOR : FRAME_UNKNOWN;
+    default: return FRAME_UNKNOWN;
+  }
+}
 
+static void classic_handle_frame(chip_state_t *chip) {
   // Обработка второй фазы MIFARE WRITE, если она ожидается
   if (chip->pending_write_block != -1 && chip->fifo_len == 18) {
     printf("Processing MIFARE WRITE Phase 2 (block 0x%02X) - received 18 bytes (16 data + 2 CRC)\n", chip->pending_write_block);
-    // Проверяем, авторизован ли доступ к сектору
-    bool allow_write = chip->authenticated;
-    if (chip->pending_write_block == 0) { // UID block
-      allow_write = true; // Always allow write to block 0 for now (can be restricted later by authentication or backdoor)
-    }
+    // Проверяем, авторизован ли доступ к сектору (блок 0 уже проверен в первой фазе)
+    bool allow_write = chip->picc_state == PICC_AUTHENTICATED || chip->magic_unlocked;
 
-    if (allow_write) {
-      // Копируем только 16 байт данных, игнорируя последние 2 байта CRC
-      memcpy(&chip->card_data[chip->pending_write_block * 16], chip->fifo, 16);
+    if (allow_write && !card_write(chip, chip->pending_write_block, chip->fifo, 16)) {
+      send_nak_response(chip);
+    } else if (allow_write) {
+      // Скопированы только 16 байт данных, последние 2 байта CRC проигнорированы
       if (chip->pending_write_block == 0) {
         // Update UID from block 0
-        memcpy(chip->uid, &chip->card_data[0], 4);
+        memcpy(chip->uid, card_block(chip, 0), 4);
+        printf("Block 0 written (%s card), new UID %02X %02X %02X %02X\n", CARD_MAGIC_NAMES[chip->card_magic],
+               chip->uid[0], chip->uid[1], chip->uid[2], chip->uid[3]);
       }
       
       // Отправляем 4-битный ACK
@@ -575,30 +1766,31 @@ void process_mifare_command(chip_state_t *chip) {
   // NEW: Обработка второй фазы двухступенчатых MIFARE команд (Decrement, Increment, Restore, Transfer)
   // These commands are split into two PCD_MIFARE_Transceive calls.
   // First call: command + block address
-  // Second call: 4 bytes of data (for Increment/Decrement) or 0 (for Restore/Transfer)
-  if (chip->pending_mifare_twostep_command != -1 && chip->fifo_len == 4) { // Expecting 4 bytes of data
+  // Second call: 4 bytes of data (for Increment/Decrement) or 0 (for Restore), followed by CRC_A
+  if (chip->pending_mifare_twostep_command != -1 && chip->fifo_len == 6) { // Expecting 4 bytes of data + CRC
       uint8_t command = chip->pending_mifare_twostep_command;
       uint8_t blockAddr = chip->pending_mifare_twostep_block_addr;
       
-      if (chip->authenticated) {
+      if (chip->picc_state == PICC_AUTHENTICATED) {
+          bool stored = true;
           switch (command) {
               case CMD_DECREMENT: {
                   int32_t delta = decode_mifare_value(chip->fifo);
-                  memcpy(chip->internal_data_register, &chip->card_data[blockAddr * 16], 16);
+                  memcpy(chip->internal_data_register, card_block(chip, blockAddr), 16);
                   int32_t currentValue = decode_mifare_value(chip->internal_data_register);
                   currentValue -= delta;
                   encode_mifare_value(chip->internal_data_register, currentValue, blockAddr);
-                  memcpy(&chip->card_data[blockAddr * 16], chip->internal_data_register, 16);
+                  stored = card_write(chip, blockAddr, chip->internal_data_register, 16);
                   printf("MIFARE DECREMENT executed on block 0x%02X with delta %d. New value: %d\n", blockAddr, delta, currentValue);
                   break;
               }
               case CMD_INCREMENT: {
                   int32_t delta = decode_mifare_value(chip->fifo);
-                  memcpy(chip->internal_data_register, &chip->card_data[blockAddr * 16], 16);
+                  memcpy(chip->internal_data_register, card_block(chip, blockAddr), 16);
                   int32_t currentValue = decode_mifare_value(chip->internal_data_register);
                   currentValue += delta;
                   encode_mifare_value(chip->internal_data_register, currentValue, blockAddr);
-                  memcpy(&chip->card_data[blockAddr * 16], chip->internal_data_register, 16);
+                  stored = card_write(chip, blockAddr, chip->internal_data_register, 16);
                   printf("MIFARE INCREMENT executed on block 0x%02X with delta %d. New value: %d\n", blockAddr, delta, currentValue);
                   break;
               }
@@ -613,8 +1805,12 @@ void process_mifare_command(chip_state_t *chip) {
                   printf("MIFARE TRANSFER Phase 2 (data) received, data ignored. Command for block 0x%02X\n", blockAddr);
                   break;
           }
-          // Send 4-bit ACK
-          send_ack_response(chip);
+          // Send 4-bit ACK, NAK if the value could not be stored
+          if (stored) {
+              send_ack_response(chip);
+          } else {
+              send_nak_response(chip);
+          }
       } else {
           printf("Two-step command (0x%02X) Phase 2 failed: not authenticated for block 0x%02X.\n", command, blockAddr);
           chip->fifo_len = 0;
@@ -627,35 +1823,19 @@ void process_mifare_command(chip_state_t *chip) {
 
 
   uint8_t cmd = chip->fifo[0];
-  printf("Processing MIFARE command: 0x%02X (fifo_len=%d, anticoll_step=%d)\n", cmd, chip->fifo_len, chip->anticoll_step);
+  printf("Processing MIFARE command: 0x%02X (fifo_len=%d)\n", cmd, chip->fifo_len);
 
   switch (cmd) {
-    case CMD_REQA:
-    case CMD_WUPA:
-      // printf("Handling REQA/WUPA command\n");
-      handle_reqa_wupa_command(chip);
-      break;
-
-    case CMD_SEL_CL1:
-    case CMD_SEL_CL2:
-    case CMD_SEL_CL3:
-      if (chip->anticoll_step == 1 && chip->fifo_len >= 9) {
-        handle_select_command(chip);
-      } else {
-      handle_anticoll_command(chip);
-      }
-      break;
-
     case CMD_READ:
       // printf("Handling READ command (block 0x%02X)\n", chip->fifo[1]);
-      if (chip->authenticated) {
+      if (chip->picc_state == PICC_AUTHENTICATED || chip->magic_unlocked) {
         if (chip->fifo_len >= 2) {
           uint8_t blockAddr = chip->fifo[1];
-          if (blockAddr < 64) { // 16 sectors * 4 blocks/sector
+          if (blockAddr < chip->personality->blocks) {
             printf("Reading block %d\n", blockAddr);
             // Copy 16 bytes from emulated card memory
             chip->fifo_len = 0; // Clear FIFO before filling
-            memcpy(chip->fifo, &chip->card_data[blockAddr * 16], 16);
+            memcpy(chip->fifo, card_block(chip, blockAddr), 16);
             
             // Append CRC
             uint8_t crc[2];
@@ -687,15 +1867,23 @@ void process_mifare_command(chip_state_t *chip) {
     case CMD_WRITE:
       printf("Handling WRITE command (block 0x%02X)\n", chip->fifo[1]);
       uint8_t blockAddr = chip->fifo[1];
-      bool allow_write = false;
-      if (chip->authenticated) {
-        allow_write = true;
+      bool allow_write = chip->picc_state == PICC_AUTHENTICATED || chip->magic_unlocked;
+      // Блок производителя пишется только через открытый бэкдор Gen1a или на карте Gen2
+      if (allow_write && blockAddr == 0 && !chip->magic_unlocked && chip->card_magic != MAGIC_GEN2) {
+        printf("WRITE of block 0 refused: manufacturer block is read-only (%s card), NAK\n",
+               CARD_MAGIC_NAMES[chip->card_magic]);
+        send_nak_response(chip);
+        picc_fall_back(chip);
+        break;
       }
-      // Разрешить запись в блок 0, если открыт backdoor
-      if (blockAddr == 0 && chip->uid_backdoor_open) {
-        allow_write = true;
+      if (allow_write && blockAddr >= chip->personality->blocks) {
+        printf("WRITE failed: block address %d is out of bounds, NAK\n", blockAddr);
+        send_nak_response(chip);
+        picc_fall_back(chip);
+        break;
+      }
+      if (allow_write && blockAddr == 0 && chip->magic_unlocked) {
         printf("Backdoor open: allowing write to block 0 without authentication!\n");
-        chip->uid_backdoor_open = false; // Сбросить после успешной записи
       }
       if (allow_write) {
         if (chip->fifo_len >= 2) { // CMD_WRITE + block_addr + CRC
@@ -725,13 +1913,15 @@ void process_mifare_command(chip_state_t *chip) {
       // Phase 1 of MIFARE Two-Step Commands (command + block address)
       if (chip->fifo_len >= 2) {
           uint8_t blockAddr = chip->fifo[1];
-          if (blockAddr < 64) {
-              chip->pending_mifare_twostep_command = cmd;
-              chip->pending_mifare_twostep_block_addr = blockAddr;
+          if (blockAddr < chip->personality->blocks) {
+              if (cmd != CMD_TRANSFER) { // TRANSFER has no data part
+                  chip->pending_mifare_twostep_command = cmd;
+                  chip->pending_mifare_twostep_block_addr = blockAddr;
+              }
               
               if (cmd == CMD_RESTORE) {
-                  if (chip->authenticated) {
-                      memcpy(chip->internal_data_register, &chip->card_data[blockAddr * 16], 16);
+                  if (chip->picc_state == PICC_AUTHENTICATED) {
+                      memcpy(chip->internal_data_register, card_block(chip, blockAddr), 16);
                       printf("MIFARE RESTORE executed: block 0x%02X restored to internal register.\n", blockAddr);
                   } else {
                       printf("MIFARE RESTORE failed: not authenticated for block 0x%02X.\n", blockAddr);
@@ -740,8 +1930,11 @@ void process_mifare_command(chip_state_t *chip) {
                       return;
                   }
               } else if (cmd == CMD_TRANSFER) {
-                  if (chip->authenticated) {
-                      memcpy(&chip->card_data[blockAddr * 16], chip->internal_data_register, 16);
+                  if (chip->picc_state == PICC_AUTHENTICATED) {
+                      if (!card_write(chip, blockAddr, chip->internal_data_register, 16)) {
+                          send_nak_response(chip);
+                          return;
+                      }
                       printf("MIFARE TRANSFER executed: internal register transferred to block 0x%02X.\n", blockAddr);
                   } else {
                       printf("MIFARE TRANSFER failed: not authenticated for block 0x%02X.\n", blockAddr);
@@ -774,9 +1967,12 @@ void process_mifare_command(chip_state_t *chip) {
         // Page 0 is R/O UID, Page 1 is R/O internal, Page 2 is R/W
         // The lib tests write to page 4.
         if (pageAddr >= 2 && pageAddr < 16) {
-          memcpy(&chip->card_data[pageAddr * 16], &chip->fifo[2], 4); // Copy only 4 bytes
-          // Отправляем 4-битный ACK
-          send_ack_response(chip);
+          if (card_write(chip, pageAddr, &chip->fifo[2], 4)) { // Copy only 4 bytes
+            // Отправляем 4-битный ACK
+            send_ack_response(chip);
+          } else {
+            send_nak_response(chip);
+          }
         } else {
           printf("MIFARE ULTRALIGHT WRITE failed: page address %d out of bounds or read-only.\n", pageAddr);
           chip->fifo_len = 0;
@@ -789,108 +1985,229 @@ void process_mifare_command(chip_state_t *chip) {
       }
       break;
 
-    case 0x50: // HALT
-      reset_chip_state(chip); // Сброс состояния для переподключения
-      chip->fifo_len = 0;
-      chip->uid_backdoor_step1 = true; // Установить для следующей команды 0x40
-      // set_specific_irq_flag(chip, 0x10); // IdleIRq - Удалена эта строка
-      printf("HALT command received. Card state reset for re-discovery. No response will be sent.\n");
+    case 0x40:
+    case 0x43:
+      gen1a_handle_frame(chip);
       break;
+
+    case CMD_AUTH_A:
+    case CMD_AUTH_B:
+      handle_auth_command(chip);
+      break;
+  }
+}
+
+// A WRITE or value operation waiting for its second part is dropped, an unlocked Gen1a card locks again
+static void classic_halt(chip_state_t *chip) {
+  chip->magic_unlocked = false;
+  chip->pending_write_block = -1;
+  chip->pending_write_len = 0;
+  chip->pending_mifare_twostep_command = -1;
+}
+
+static void classic_load(chip_state_t *chip, const card_template_t *card) {
+  memcpy(chip->fresh_block0, card->block0, 16);
+  memcpy(chip->uid, card->block0, 4);
+  chip->uid_size = 4;
+}
+
+static const uint8_t *classic_fresh_block(chip_state_t *chip, uint8_t block) {
+  (void)chip;
+  return block == classic_trailer(block) ? DEFAULT_TRAILER : BLANK_BLOCK;
+}
+
+// Sector trailer of a block: sectors 0-31 have 4 blocks, the 4K sectors 32-39 have 16
+static uint8_t classic_trailer(uint8_t block) {
+  return block < 128 ? (block | 0x03) : (block | 0x0F);
+}
+
+// Chinese magic card (Gen1a) backdoor of the Classic personalities: 0x40 sent with 7 bits is answered in
+// IDLE/HALT, 0x43 right after it makes the card ACTIVE without SELECT. Until the card leaves ACTIVE every
+// block, block 0 included, is read and written without authentication. A locked card NAKs the 0x43.
+static void gen1a_handle_frame(chip_state_t *chip) {
+  switch (chip->fifo[0]) {
     case 0x40:
-      if (chip->uid_backdoor_step1) {
-        send_ack_response(chip);
-        chip->uid_backdoor_step1 = false;
-        chip->uid_backdoor_open = true; // разрешаем следующий шаг
-      } else {
+      if ((chip->registers[0x0D] & 0x07) != 7) { // BitFramingReg.TxLastBits: 0x40 is a 7 bit frame
         chip->fifo_len = 0;
+        update_fifo_level_register(chip);
+        break;
       }
+      // IDLE или HALT: бэкдор отвечает ACK и ждёт 0x43
+      send_ack_response(chip);
+      chip->uid_backdoor_open = true; // разрешаем следующий шаг
       break;
     case 0x43:
-      if (chip->uid_backdoor_open) {
-        send_ack_response(chip);
-        // Теперь разрешить запись в сектор 0
-        chip->uid_backdoor_open = true;
-      } else {
+      if (!chip->uid_backdoor_open) {
         chip->fifo_len = 0;
+        update_fifo_level_register(chip);
+      } else if (chip->card_magic == MAGIC_LOCKED) {
+        printf("Backdoor 0x43 refused: UID of this card is locked, NAK\n");
+        chip->uid_backdoor_open = false;
+        send_nak_response(chip);
+      } else {
+        send_ack_response(chip);
+        // Карта выбрана без SELECT, чтение и запись без аутентификации до HLTA
+        set_picc_state(chip, PICC_ACTIVE);
+        chip->magic_unlocked = true;
+        printf("Gen1a backdoor unlocked at %u us\n", (unsigned)(get_sim_nanos() / 1000));
       }
       break;
+  }
+}
 
-    case CMD_AUTH_A:
-    case CMD_AUTH_B:
-      // printf("Handling AUTHENTICATE command\n");
-      // Simplified authentication: we just check the command in FIFO.
-      // A real implementation would check the key against the sector trailer.
-      if (chip->fifo_len >= 1 && (chip->fifo[0] == CMD_AUTH_A || chip->fifo[0] == CMD_AUTH_B)) {
-          printf("Authentication successful (simulated)\n");
-          chip->authenticated = true;
-          // The command completes when IdleIRq is set.
-          set_specific_irq_flag(chip, 0x10); // IdleIRq
-      } else {
-          printf("Authentication failed: incorrect command in FIFO (len=%d)\n", chip->fifo_len);
-          // Maybe set an error flag? For now, do nothing and let it time out.
+// MIFARE Ultralight / NTAG213 personality: 4 byte pages, no authentication. READ returns four pages and rolls
+// over at the end of the memory, WRITE (0xA2) writes one page. Pages 0-1 hold the UID and are read-only, the
+// lock bytes of page 2 and the OTP/CC page 3 can only be set bit by bit; lock bits are not enforced.
+// An invalid command or page is answered with NAK and the card falls back to IDLE/HALT.
+static frame_type_t ultralight_classify(chip_state_t *chip) {
+  switch (chip->fifo[0]) {
+    case CMD_READ:
+    case CMD_UL_WRITE: return FRAME_MEMORY;
+    default: return FRAME_UNKNOWN;
+  }
+}
+
+static frame_type_t ntag_classify(chip_state_t *chip) {
+  return chip->fifo[0] == CMD_GET_VERSION ? FRAME_MEMORY : ultralight_classify(chip);
+}
+
+static void ultralight_handle_frame(chip_state_t *chip) {
+  uint8_t pages = chip->personality->pages;
+  uint8_t page = chip->fifo[1];
+  printf("Processing %s command: 0x%02X (page 0x%02X)\n", chip->personality->name, chip->fifo[0], page);
+  switch (chip->fifo[0]) {
+    case CMD_READ:
+      if (chip->fifo_len < 2 || page >= pages) {
+        break;
       }
-      chip->fifo_len = 0; // Clear FIFO after auth attempt
-      update_fifo_level_register(chip);
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+      for (uint8_t i = 0; i < 4; i++) {
+        uint8_t p = (page + i) % pages;
+        memcpy(&chip->fifo[i * 4], card_block(chip, p / 4) + (p % 4) * 4, 4);
+      }
+      send_response_with_crc(chip, 16);
+      return;
 
-    case CMD_CT:
-      // printf("Handling CT command (Transceive)\n");
-      // This command is typically used for Transmit and Receive.
-      // For self-test, we just acknowledge it.
-      set_specific_irq_flag(chip, 0x20); // TxIRq
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+    case CMD_UL_WRITE: {
+      if (chip->fifo_len < 6 || page < 2 || page >= pages) {
+        break;
+      }
+      uint8_t *data = card_block_mut(chip, page / 4);
+      if (data == NULL) {
+        send_nak_response(chip);
+        return;
+      }
+      data += (page % 4) * 4;
+      if (page == 2) {
+        data[2] |= chip->fifo[4]; // Lock bytes, BCC1 and the internal byte stay
+        data[3] |= chip->fifo[5];
+      } else if (page == 3) {
+        for (uint8_t i = 0; i < 4; i++) {
+          data[i] |= chip->fifo[2 + i];
+        }
+      } else {
+        memcpy(data, &chip->fifo[2], 4);
+      }
+      send_ack_response(chip);
+      return;
+    }
 
-    case CMD_CALC_CRC:
-      // printf("Handling CALC_CRC command\n");
-      perform_crc_calculation(chip);
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+    case CMD_GET_VERSION:
+      memcpy(chip->fifo, NTAG213_VERSION, sizeof(NTAG213_VERSION));
+      send_response_with_crc(chip, sizeof(NTAG213_VERSION));
+      return;
+  }
+  printf("%s: invalid command or page 0x%02X, NAK\n", chip->personality->name, page);
+  send_nak_response(chip);
+  picc_fall_back(chip);
+}
 
-    case CMD_IDLE:
-      // printf("Handling IDLE command\n");
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+// Pages 0-3: UID0-2 and BCC0 (with the cascade tag), UID3-6, BCC1, internal byte and lock bytes, OTP
+static void ultralight_load(chip_state_t *chip, const card_template_t *card) {
+  const uint8_t *uid = card->uid7;
+  memcpy(chip->uid, uid, 7);
+  chip->uid_size = 7;
+  uint8_t *block = chip->fresh_block0;
+  memset(block, 0, 16);
+  memcpy(&block[0], &uid[0], 3);
+  block[3] = CMD_CT ^ uid[0] ^ uid[1] ^ uid[2];
+  memcpy(&block[4], &uid[3], 4);
+  block[8] = uid[3] ^ uid[4] ^ uid[5] ^ uid[6];
+  block[9] = 0x48;
+}
 
-    case CMD_MEM:
-      // printf("Handling MEM command (Transfer FIFO to internal buffer)\n");
-      // This command transfers FIFO data to internal buffer for self-test
-      // In our emulation, we just acknowledge the command
-      set_specific_irq_flag(chip, 0x10); // IdleIRq
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+// NTAG213: page 3 is the NFC Forum capability container, 144 bytes of NDEF memory
+static void ntag_load(chip_state_t *chip, const card_template_t *card) {
+  ultralight_load(chip, card);
+  chip->fresh_block0[12] = 0xE1;
+  chip->fresh_block0[13] = 0x10;
+  chip->fresh_block0[14] = 0x12;
+}
 
-    case CMD_GEN_RANDOM_ID:
-      // printf("Handling GEN_RANDOM_ID command\n");
-      // This command generates a random ID for self-test
-      // In our emulation, we just acknowledge the command
-      set_specific_irq_flag(chip, 0x10); // IdleIRq
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+static const uint8_t *ultralight_fresh_block(chip_state_t *chip, uint8_t block) {
+  (void)chip;
+  (void)block;
+  return BLANK_BLOCK;
+}
 
-    case CMD_TRANSMIT:
-      // printf("Handling TRANSMIT command\n");
-      // This command transmits data from FIFO for self-test
-      // In our emulation, we just acknowledge the command
-      set_specific_irq_flag(chip, 0x20); // TxIRq
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+// Blocks 10 and 11 hold the configuration pages 0x28-0x2C
+static const uint8_t *ntag_fresh_block(chip_state_t *chip, uint8_t block) {
+  (void)chip;
+  return block >= 10 ? NTAG213_CONFIG_BLOCKS[block - 10] : BLANK_BLOCK;
+}
 
-    case CMD_RECEIVE:
-      // printf("Handling RECEIVE command\n");
-      // This command activates the receiver for self-test
-      // In our emulation, we just acknowledge the command
-      set_specific_irq_flag(chip, 0x10); // IdleIRq
-      chip->registers[0x01] = 0; // Go to Idle
-      break;
+// ISO-DEP (ISO/IEC 14443-4) personality, enough for MFRC522Extended: RATS is answered with the ATS, PPS is
+// confirmed. I-blocks get an I-block with the same block number and an ISO 7816-4 status word (9000 for SELECT,
+// 6D00 for any other instruction), R-blocks an R(ACK), S(DESELECT) is confirmed and halts the card. No chaining,
+// no WTX and no file system.
+static frame_type_t iso_dep_classify(chip_state_t *chip) {
+  uint8_t pcb = chip->fifo[0];
+  if (!chip->iso_dep_active) {
+    return pcb == CMD_RATS ? FRAME_MEMORY : FRAME_UNKNOWN;
+  }
+  if ((pcb & 0xF0) == CMD_PPS || (pcb & 0xE2) == 0x02 || (pcb & 0xE6) == 0xA2 || (pcb & 0xF7) == 0xC2) {
+    return FRAME_MEMORY;
+  }
+  return FRAME_UNKNOWN;
+}
 
-    default:
-      printf("Unknown MIFARE command: 0x%02X\n", cmd);
-      break;
+static void iso_dep_handle_frame(chip_state_t *chip) {
+  uint8_t pcb = chip->fifo[0];
+  uint8_t inf = (pcb & 0x08) ? 2 : 1; // The CID byte follows the PCB
+  if (pcb == CMD_RATS) {
+    printf("ISO-DEP RATS (FSDI %u, CID %u), sending ATS\n", chip->fifo[1] >> 4, chip->fifo[1] & 0x0F);
+    memcpy(chip->fifo, chip->personality->ats, chip->personality->ats[0]);
+    chip->iso_dep_active = true;
+    send_response_with_crc(chip, chip->personality->ats[0]);
+  } else if ((pcb & 0xF0) == CMD_PPS) {
+    send_response_with_crc(chip, 1); // PPS response: PPSS
+  } else if ((pcb & 0xF7) == 0xC2) {
+    printf("ISO-DEP DESELECT, card halted\n");
+    send_response_with_crc(chip, inf);
+    set_picc_state(chip, PICC_HALT);
+  } else if ((pcb & 0xE6) == 0xA2) {
+    chip->fifo[0] = pcb & ~0x10; // R(ACK), same block number
+    send_response_with_crc(chip, inf);
+  } else {
+    // I-block: CLA INS P1 P2 ...
+    bool select = chip->fifo_len >= inf + 4 && chip->fifo[inf + 1] == 0xA4;
+    chip->fifo[0] = pcb & 0x0B; // No chaining, same block number and CID
+    chip->fifo[inf] = select ? 0x90 : 0x6D;
+    chip->fifo[inf + 1] = 0x00;
+    send_response_with_crc(chip, inf + 2);
   }
 }
 
+// Activation and deactivation both end the ISO 14443-4 protocol
+static void iso_dep_reset(chip_state_t *chip) {
+  chip->iso_dep_active = false;
+}
+
+static void iso_dep_load(chip_state_t *chip, const card_template_t *card) {
+  memcpy(chip->uid, card->uid7, 7);
+  chip->uid_size = 7;
+  memset(chip->fresh_block0, 0, 16);
+}
+
 // SPI read/write functions
 static void read_version_register(chip_state_t *chip) {
   chip->spi_buffer[0] = 0x92;
@@ -967,6 +2284,10 @@ static void handle_spi_read_command(chip_state_t *chip) {
     chip->spi_buffer[0] = val;
     chip->read_count = 1;
 //     printf("ErrorReg read: 0x%02X\n", val);
+  } else if (chip->current_address == ENERGY_DATA_REG) {
+    // Energy window: next byte of the latched item
+    chip->spi_buffer[0] = chip->energy_byte < 4 ? chip->energy_latch[chip->energy_byte++] : 0;
+    chip->read_count = 1;
   } else if (chip->current_address == 0x36) {
     // Чтение AutoTestReg - важно для self-test
     chip->spi_buffer[0] = val;
@@ -980,6 +2301,9 @@ static void handle_spi_read_command(chip_state_t *chip) {
 
 static void write_fifo_register(chip_state_t *chip, uint8_t val) {
   if (chip->fifo_len < FIFO_SIZE) {
+    if (chip->fifo_len == 0) {
+      chip->frame_command = val;
+    }
     fifo_push(chip, val);
     
     // Отладка для всех входящих байтов
@@ -1003,21 +2327,7 @@ static void write_fifo_register(chip_state_t *chip, uint8_t val) {
 //     } else {
 //       printf("\n");
 //     }
-
-    // Проверяем, собираем ли мы SELECT команду
-    if (chip->fifo[0] == CMD_SEL_CL1 && chip->anticoll_step == 1) {
-//       printf("Building SELECT command: %d bytes received: ", chip->fifo_len);
-//       for (int i = 0; i < chip->fifo_len; i++) {
-//         printf("%02X ", chip->fifo[i]);
-//       }
-//       printf("\n");
-      
-      // Если получили все 9 байт SELECT команды
-      if (chip->fifo_len == 9) {
-//         printf("Full SELECT command received, processing...\n");
-        process_mifare_command(chip);
-      }
-    }
+    // SELECT обрабатывается вместе с остальными кадрами, когда выполняется Transceive
   } else {
     printf("FIFO full, ignoring: 0x%02X\n", val);
   }
@@ -1025,6 +2335,43 @@ static void write_fifo_register(chip_state_t *chip, uint8_t val) {
 
 static void write_command_register(chip_state_t *chip, uint8_t val) {
 //   printf("CommandReg = 0x%02X\n", val);
+  // PowerDown bit (bit 4) with the Idle command: 1 enters soft power-down, 0 starts the wake-up. The bit reads 1
+  // until the oscillator is stable again (datasheet 8.6.2); commands written meanwhile are not executed.
+  if (chip->soft_power_down || (val & ~0x20) == 0x10) {
+    if (val & 0x10) {
+      if (chip->osc_starting) {
+        timer_stop(chip->osc_timer);
+        chip->osc_starting = false;
+      }
+      pcd_queue_cancel(chip, false); // Commands still queued never run
+      chip->transceive_active = false; // PowerDown comes with the Idle command, StartSend has nothing to restart
+      chip->soft_power_down = true;
+      chip->registers[0x01] = val; // Set the command to PowerDown
+      chip->registers[0x04] |= 0x10; // Set IdleIRq (from datasheet, or observation)
+      chip->registers[0x04] &= ~(0x20 | 0x40); // Clear RxIRq and TxIRq
+    } else if (!chip->osc_starting) {
+      // printf("Transition from PowerDown to Active (PCD_SoftPowerUp) by writing 0x%02X\n", val);
+      chip->registers[0x01] = (val & 0x20) | 0x10;
+      chip->registers[0x04] &= ~0x10; // Clear IdleIRq (indicating wake-up)
+      start_oscillator(chip);
+    }
+    return;
+  }
+  // The command runs from the PCD scheduler, CommandReg shows it until then
+  if ((val & 0x0F) == 0x0F) {
+    pcd_queue_cancel(chip, false); // SoftReset: nothing queued before it may complete after it
+  }
+  chip->registers[0x01] = val;
+  pcd_queue_push(chip, PCD_EVENT_COMMAND, val, 0, 0, 0);
+}
+
+// Execute a command queued by write_command_register(), see pcd_event_t
+static void execute_command(chip_state_t *chip, uint8_t val) {
+  pcd_queue_cancel(chip, true); // A new command ends the running one
+  chip->transceive_active = false; // Any command ends a running Transceive
+  uint8_t com_before = chip->registers[0x04];
+  uint8_t div_before = chip->registers[0x05];
+  uint64_t duration_ns = 0;
   switch (val) {
     case CMD_IDLE: // 0x00
       // printf("Command 0x00 - PCD_Idle (Idle)\n");
@@ -1047,6 +2394,7 @@ static void write_command_register(chip_state_t *chip, uint8_t val) {
 
     case CMD_CALC_CRC: // 0x03
       // printf("Command 0x03 - PCD_CalcCRC (Calculate CRC)\n");
+      duration_ns = chip->fifo_len * CRC_BYTE_NS;
       if (chip->registers[0x36] == 0x09) { // Self-test mode
         // printf("Self-test mode detected - generating 64 bytes of test data\n");
         const uint8_t self_test_data[64] = {
@@ -1063,6 +2411,7 @@ static void write_command_register(chip_state_t *chip, uint8_t val) {
         memcpy(chip->fifo, self_test_data, 64);
         chip->fifo_len = 64;
         update_fifo_level_register(chip);
+        duration_ns = 64 * CRC_BYTE_NS;
         // printf("Self-test data generated: 64 bytes in FIFO\n");
       } else {
         perform_crc_calculation(chip);
@@ -1072,6 +2421,7 @@ static void write_command_register(chip_state_t *chip, uint8_t val) {
 
     case CMD_TRANSMIT: // 0x04
       // printf("Command 0x04 - PCD_Transmit (Transmit data from FIFO)\n");
+      duration_ns = chip->fifo_len * AIR_BYTE_NS;
       set_specific_irq_flag(chip, 0x20); // TxIRq
       chip->registers[0x01] = 0x00; // Go to Idle
       break;
@@ -1084,24 +2434,24 @@ static void write_command_register(chip_state_t *chip, uint8_t val) {
 
     case 0x0C: // PCD_Transceive
       // printf("Command 0x0C - PCD_Transceive (Transmit and receive)\n");
-      if (chip->fifo_len > 0) {
-    process_mifare_command(chip);
-      }
+      // The library loads the FIFO first, so the exchange runs now; with an empty FIFO it waits for StartSend
+      chip->transceive_active = true;
+      chip->transceive_sent = chip->fifo_len > 0;
+      run_transceive(chip);
       chip->registers[0x01] = 0x00; // Go to Idle
       break;
 
     case 0x0E: // PCD_MFAuthent
       // printf("Command 0x0E - PCD_MFAuthent (MIFARE Authenticate)\n");
-      if (chip->fifo_len >= 1 && (chip->fifo[0] == CMD_AUTH_A || chip->fifo[0] == CMD_AUTH_B)) {
-          printf("Authentication successful (simulated)\n");
-          chip->authenticated = true;
-          set_specific_irq_flag(chip, 0x10); // IdleIRq
-    } else {
-          printf("Authentication failed: incorrect command in FIFO (len=%d)\n", chip->fifo_len);
+      handle_auth_command(chip);
+      account_transceive(chip, 4 + 8, 4 + 4); // Auth command + reader token, tag nonce + tag token
+      // Auth command, tag nonce, reader token; then the tag token or, with a wrong key, the timer
+      duration_ns = (4 + 4 + 8) * AIR_BYTE_NS + PICC_FDT_NS;
+      if (chip->registers[0x04] & ~com_before & 0x01) {
+        duration_ns += pcd_timer_ns(chip);
+      } else {
+        duration_ns += PICC_FDT_NS + 4 * AIR_BYTE_NS;
       }
-      chip->fifo_len = 0;
-      update_fifo_level_register(chip);
-      chip->registers[0x01] = 0x00; // Go to Idle
       break;
 
     case 0x0F: { // PCD_SoftReset
@@ -1111,32 +2461,139 @@ static void write_command_register(chip_state_t *chip, uint8_t val) {
       break;
     }
 
-    case 0x10: { // Special handling for PowerDown bit (bit 4 of CommandReg)
-      // This case handles writing 0x10 to CommandReg, which implies PCD_SoftPowerDown.
-      // printf("Command 0x10 - PCD_SoftPowerDown (Power Down)\n");
-      chip->registers[0x01] = val; // Set the command to PowerDown
-      chip->registers[0x04] |= 0x10; // Set IdleIRq (from datasheet, or observation)
-      chip->registers[0x04] &= ~(0x20 | 0x40); // Clear RxIRq and TxIRq
-      break;
-    }
-
     default:
       // Other commands may just set the CommandReg and let other logic handle it.
-      // If it's a command that transitions from PowerDown to Active (PCD_SoftPowerUp)
-      // The library does this by writing any non-0x10 value to CommandReg
-      if ((chip->registers[0x01] & 0x10) && !(val & 0x10)) {
-        // printf("Transition from PowerDown to Active (PCD_SoftPowerUp) by writing 0x%02X\n", val);
-        chip->registers[0x01] = val; // Store the new command
-        chip->registers[0x04] &= ~0x10; // Clear IdleIRq (indicating wake-up)
-        // LoAlertIRq and HiAlertIRq might be set here depending on specific conditions
-        // For simplicity, we can set them if the library expects them for a successful power up.
-        // As per MFRC522.cpp, PCD_SoftPowerUp expects PowerDown bit to be cleared.
-        // It does not explicitly check HiAlertIRq/LoAlertIRq.
-      } else {
-        chip->registers[0x01] = val; // Default: just store the value
-      }
+      chip->registers[0x01] = val; // Default: just store the value
       break;
   }
+  pcd_finish_after(chip, com_before, div_before, duration_ns);
+}
+
+// One PICC exchange of the Transceive command: the FIFO is sent, the answer replaces it. TxIRq is raised when the
+// frame is sent, the answer arrives after the frame delay time. Without an answer the timer, started at the end of
+// the transmission if TModeReg.TAuto is set, raises TimerIRq when it runs out.
+static void run_transceive(chip_state_t *chip) {
+  if (chip->fifo_len == 0) {
+    return;
+  }
+  pcd_queue_cancel(chip, true); // StartSend restarts the exchange and the timer
+  uint8_t com_before = chip->registers[0x04];
+  uint8_t div_before = chip->registers[0x05];
+  uint8_t tx_bytes = chip->fifo_len;
+  uint8_t command = chip->frame_command;
+  chip->registers[0x06] = 0x00; // ErrorReg: new exchange
+  process_mifare_command(chip);
+  account_transceive(chip, tx_bytes, chip->fifo_len);
+  apply_link_quality(chip);
+  inject_fault(chip, command);
+
+  uint64_t tx_ns = tx_bytes * AIR_BYTE_NS;
+  pcd_queue_push(chip, PCD_EVENT_RESULT, 0, tx_ns, 0x40, 0); // TxIRq
+  if (chip->fifo_len) {
+    pcd_finish_after(chip, com_before, div_before, tx_ns + PICC_FDT_NS + chip->fifo_len * AIR_BYTE_NS);
+  } else {
+    if (chip->registers[0x2A] & 0x80) {
+      set_specific_irq_flag(chip, 0x01); // TimerIRq
+    }
+    pcd_finish_after(chip, com_before, div_before, tx_ns + pcd_timer_ns(chip));
+  }
+}
+
+// Queue a PCD event delay_ns from now, behind the events due at the same time
+static void pcd_queue_push(chip_state_t *chip, uint8_t type, uint8_t value, uint64_t delay_ns, uint8_t com_irq,
+                           uint8_t div_irq) {
+  if (chip->pcd_queue_len == PCD_QUEUE_SIZE) {
+    printf("Chip %u PCD queue full, event %u dropped\n", chip->instance_id, type);
+    return;
+  }
+  uint64_t due_ns = get_sim_nanos() + delay_ns;
+  uint8_t i = chip->pcd_queue_len++;
+  while (i > 0 && chip->pcd_queue[i - 1].due_ns > due_ns) {
+    chip->pcd_queue[i] = chip->pcd_queue[i - 1];
+    i--;
+  }
+  chip->pcd_queue[i] = (pcd_event_t){due_ns, type, value, com_irq, div_irq};
+  if (i == 0) {
+    pcd_schedule(chip);
+  }
+}
+
+// Drop the queued results of the running command, or with results_only false every queued event
+static void pcd_queue_cancel(chip_state_t *chip, bool results_only) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < chip->pcd_queue_len; i++) {
+    if (results_only && chip->pcd_queue[i].type != PCD_EVENT_RESULT) {
+      chip->pcd_queue[kept++] = chip->pcd_queue[i];
+    }
+  }
+  chip->pcd_queue_len = kept;
+  pcd_schedule(chip);
+}
+
+// Start pcd_timer for the first queued event
+static void pcd_schedule(chip_state_t *chip) {
+  timer_stop(chip->pcd_timer);
+  if (chip->pcd_queue_len) {
+    uint64_t now = get_sim_nanos();
+    uint64_t due_ns = chip->pcd_queue[0].due_ns;
+    timer_start_ns(chip->pcd_timer, due_ns > now ? due_ns - now : 0, false);
+  }
+}
+
+// Hold back the interrupt request bits raised since com_before/div_before until duration_ns from now
+static void pcd_finish_after(chip_state_t *chip, uint8_t com_before, uint8_t div_before, uint64_t duration_ns) {
+  uint8_t com_irq = chip->registers[0x04] & ~com_before;
+  uint8_t div_irq = chip->registers[0x05] & ~div_before;
+  if (!duration_ns || !(com_irq | div_irq)) {
+    return;
+  }
+  chip->registers[0x04] &= ~com_irq;
+  chip->registers[0x05] &= ~div_irq;
+  pcd_queue_push(chip, PCD_EVENT_RESULT, 0, duration_ns, com_irq, div_irq);
+}
+
+// Timer period from TModeReg, TPrescalerReg, TReloadReg and DemodReg.TPrescalEven (datasheet 8.5)
+static uint64_t pcd_timer_ns(chip_state_t *chip) {
+  uint32_t prescaler = ((chip->registers[0x2A] & 0x0F) << 8) | chip->registers[0x2B];
+  uint32_t divider = 2 * prescaler + ((chip->registers[0x19] & 0x10) ? 2 : 1);
+  uint32_t reload = (chip->registers[0x2C] << 8) | chip->registers[0x2D];
+  return (uint64_t)divider * (reload + 1) * 1000000000ULL / 13560000;
+}
+
+// pcd_timer: run the events that are due
+static void chip_pcd_step(void *user_data) {
+  chip_state_t *chip = (chip_state_t *)user_data;
+  if (chip->in_reset) {
+    return; // Nothing runs in hard power-down, the queue was dropped on the falling edge
+  }
+  uint64_t now = get_sim_nanos();
+  while (chip->pcd_queue_len && chip->pcd_queue[0].due_ns <= now) {
+    pcd_event_t event = chip->pcd_queue[0];
+    chip->pcd_queue_len--;
+    memmove(chip->pcd_queue, chip->pcd_queue + 1, chip->pcd_queue_len * sizeof(pcd_event_t));
+    switch (event.type) {
+      case PCD_EVENT_COMMAND:
+        execute_command(chip, event.value);
+        break;
+      case PCD_EVENT_START_SEND:
+        if (!chip->transceive_active) {
+          break;
+        }
+        if (chip->transceive_sent) {
+          chip->transceive_sent = false;
+        } else {
+          run_transceive(chip);
+        }
+        break;
+      case PCD_EVENT_RESULT:
+        chip->registers[0x04] |= event.com_irq;
+        chip->registers[0x05] |= event.div_irq;
+        break;
+    }
+  }
+  pcd_schedule(chip);
+  update_power_state(chip);
+  update_irq_pin(chip);
 }
 
 static void handle_spi_write_command(chip_state_t *chip, uint8_t val) {
@@ -1154,29 +2611,47 @@ static void handle_spi_write_command(chip_state_t *chip, uint8_t val) {
     chip->registers[reg] = val & 0x7F; // сохраняем без бита FlushBuffer
   } else if (reg == 0x01) {
     write_command_register(chip, val);
+  } else if (reg == 0x0D) { // BitFramingReg
+    chip->registers[reg] = val;
+    if ((val & 0x80) && !chip->soft_power_down) { // StartSend, only acts while Transceive is active
+      pcd_queue_push(chip, PCD_EVENT_START_SEND, 0, 0, 0, 0);
+    }
   }
   else if (reg == 0x04) {
     // Специальная обработка ComIrqReg
     {
 //       printf("Direct write to ComIrqReg: 0x%02X (before: 0x%02X)\n", val, chip->registers[reg]);
-      // If the library attempts to clear flags by writing 0x7F, clear all flags in our emulator.
-      if (val == 0x7F) {
-          chip->registers[reg] = 0x00; // Correctly clear all IRQ flags
-          // printf("ComIrqReg cleared to 0x00 after 0x7F write.\n");
-  } else {
-          // For other values, just update the register. Specific flags will be set/cleared by other handlers.
-          chip->registers[reg] = val;
-//           printf("ComIrqReg after write: 0x%02X\n", chip->registers[reg]);
+      // Set1 (bit 7): 1 sets the marked bits, 0 clears them (datasheet 9.3.1.5). The library writes 0x7F to clear all.
+      if (val & 0x80) {
+          chip->registers[reg] |= val & 0x7F;
+      } else {
+          chip->registers[reg] &= ~val;
       }
+//       printf("ComIrqReg after write: 0x%02X\n", chip->registers[reg]);
       return; // Заменено break; на return;
     }
+  } else if (reg == 0x05) { // DivIrqReg
+    // Set2 (bit 7): 1 sets the marked bits, 0 clears them (datasheet 9.3.1.6)
+    if (val & 0x80) {
+      chip->registers[reg] |= val & 0x14;
+    } else {
+      chip->registers[reg] &= ~val;
+    }
   } else if (reg == 0x08) { // Status2Reg
 //     printf("Write to Status2Reg: 0x%02X\n", val);
     // If MFCrypto1On (bit 3) is being cleared, we should exit authenticated state.
-    if ((chip->registers[reg] & 0x08) && !(val & 0x08)) {
+    // On silicon the PICC keeps its session until the next (now unencrypted) frame; here it ends cleanly.
+    if ((chip->registers[reg] & 0x08) && !(val & 0x08) && chip->picc_state == PICC_AUTHENTICATED) {
 //         printf("Exiting authenticated state.\n");
-        chip->authenticated = false;
+        set_picc_state(chip, PICC_ACTIVE);
+    }
+    chip->registers[reg] = val;
+  } else if (reg == ENERGY_SEL_REG) {
+    uint32_t value = val < ENERGY_ITEMS ? energy_item(chip, val) : 0;
+    for (int i = 0; i < 4; i++) {
+      chip->energy_latch[i] = (value >> (8 * i)) & 0xFF;
     }
+    chip->energy_byte = 0;
     chip->registers[reg] = val;
   } else if (reg == 0x36) { // AutoTestReg
 //     printf("Write to AutoTestReg: 0x%02X\n", val);
@@ -1227,14 +2702,9 @@ static void update_fifo_level_register(chip_state_t *chip) {
 
 // State management functions
 static void reset_chip_state(chip_state_t *chip) {
-  chip->authenticated = false;
-  chip->card_selected = false;
-  chip->anticoll_step = 0;
-  chip->uid_read_completed = false;
-  chip->cascade_level = 1;
-  chip->current_level_known_bits = 0;
-  chip->select_completed = false;
-  chip->select_response_sent = 0;
+  chip->transceive_active = false;
+  chip->transceive_sent = false;
+  card_power_off(chip); // The reset switches the antenna drivers off
   chip->registers[0x04] = 0;  // Сбрасываем все флаги IRQ
 //   printf("Chip state reset - ComIrqReg cleared to 0x00\n");
 }
@@ -1257,6 +2727,25 @@ static void set_specific_irq_flag(chip_state_t *chip, uint8_t flag) {
 //   printf("After setting flag 0x%02X - ComIrqReg: 0x%02X\n", flag, chip->registers[0x04]);
 }
 
+// Drive the IRQ pin from the enabled interrupt request bits (datasheet 9.3.1.3 / 9.3.1.5)
+static void update_irq_pin(chip_state_t *chip) {
+  if (chip->in_reset) {
+    return; // The IRQ output keeps its level until the oscillator runs again
+  }
+  bool irq = (chip->registers[0x02] & chip->registers[0x04] & 0x7F) ||
+             (chip->registers[0x03] & chip->registers[0x05] & 0x14);
+  if (irq) {
+    chip->registers[0x07] |= 0x10;  // Status1Reg IRq
+  } else {
+    chip->registers[0x07] &= ~0x10;
+  }
+  uint32_t level = (irq != ((chip->registers[0x02] & 0x80) != 0)) ? HIGH : LOW;
+  if (level != chip->irq_level) {
+    chip->irq_level = level;
+    pin_write(chip->irq_pin, level);
+  }
+}
+
 static void log_chip_state(chip_state_t *chip) {
 //   printf("=== CHIP STATE ===\n");
 //   printf("ComIrqReg: 0x%02X, FIFOLevel: %d, ControlReg: 0x%02X\n", 
@@ -1282,8 +2771,23 @@ void send_ack_response(chip_state_t *chip) {
 //    printf("Sent ACK (0x0A). FIFO len: %d\n", chip->fifo_len);
 }
 
-// Global chip state
-static chip_state_t g_chip_state;
+// 4 bit NAK: invalid command or address
+static void send_nak_response(chip_state_t *chip) {
+    chip->fifo[0] = 0x00;
+    chip->fifo_len = 1;
+    update_fifo_level_register(chip);
+    set_specific_irq_flag(chip, 0x20); // RxIRq
+    chip->registers[0x0C] = (chip->registers[0x0C] & ~0x07) | 0x04; // Set RxLastBits to 4
+}
+
+// Answer of len bytes already in the FIFO, CRC_A appended
+static void send_response_with_crc(chip_state_t *chip, uint8_t len) {
+    calc_crc_a(chip->fifo, len, &chip->fifo[len]);
+    chip->fifo_len = len + 2;
+    update_fifo_level_register(chip);
+    set_specific_irq_flag(chip, 0x20); // RxIRq
+    chip->registers[0x0C] &= ~0x07; // RxLastBits = 0, whole bytes
+}
 
 void chip_pin_change(void *user_data, pin_t pin, uint32_t value);
 void chip_spi_done(void *user_data, uint8_t *buffer, uint32_t count);
\ No newline at end of file